@@ -0,0 +1,366 @@
+#pragma once
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cwchar>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+// {fmt} (https://github.com/fmtlib/fmt)
+#include <fmt/format.h>
+
+// Crc32 (https://github.com/stbrumme/crc32)
+#include <crc32/Crc32.h>
+
+// Kernel benchmark (bench_function)
+#include "benchmark.h"
+
+// The CPU name is read via cpuid on x86 / x64
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define AUTOTUNE_USE_CPUID
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// Autotune messages
+constexpr const wchar_t * MSG_AUTOTUNE_SECTION{ L"\n{}\n" };
+constexpr const wchar_t * MSG_AUTOTUNE_RESULT{ L"{:<20} {:>8.2f} GB/s\n" };
+constexpr const wchar_t * MSG_AUTOTUNE_SAVED{ L"\nProfile for '{}' saved to '{}'\n" };
+constexpr const wchar_t * MSG_INFO_PROFILE{ L"Autotune profile: kernel {}, prefetch {} bytes, block size {} bytes\n" };
+constexpr const wchar_t * MSG_ERROR_PROFILE_SAVE{ L"Unable to save the profile to '{}'\n" };
+constexpr const wchar_t * MSG_ERROR_AUTOTUNE_FILE{ L"Unable to create the temporary file '{}'\n" };
+
+// Candidates for the look-ahead of the prefetching kernels and the read block size
+constexpr std::size_t AUTOTUNE_PREFETCH[]{ 64, 128, 256, 512, 1024, 2048 };
+constexpr std::size_t AUTOTUNE_BLOCK_SIZES[]{ 65536, 131072, 262144, 1048576, 4194304, 16777216 };
+
+// Kernels are compared on buffers of this size
+constexpr std::size_t AUTOTUNE_KERNEL_SIZE{ 1048576 }; // 1 Mb
+
+// Size of the temporary file read with every block size
+constexpr std::size_t AUTOTUNE_FILE_SIZE{ 67108864 }; // 64 Mb
+
+// Time spent on every kernel / look-ahead, the best of all repetitions is kept
+constexpr std::chrono::milliseconds AUTOTUNE_DURATION{ 30 };
+constexpr std::size_t AUTOTUNE_REPEAT{ 3 };
+
+// Constants tuned for one host
+struct tune_profile
+{
+    std::string cpu{};          // profile is ignored on other CPUs (e.g. a shared home directory)
+    std::string kernel{};
+    std::size_t prefetch{ 256 };
+    std::size_t block_size{ 0x0 }; // 0 = size depends on the file size
+};
+
+
+// Read an environment variable holding a path
+inline std::filesystem::path env_path( const wchar_t * name )
+{
+#ifdef _MSC_VER
+    wchar_t * value{ nullptr };
+    std::size_t length{ 0x0 };
+
+    if (_wdupenv_s( &value, &length, name ) != 0 || value == nullptr)
+        return {};
+
+    std::filesystem::path result( value );
+    std::free( value );
+
+    return result;
+#else
+    auto const value = std::getenv( std::string( name, name + std::wcslen( name ) ).c_str() );
+    return value ? std::filesystem::path( value ) : std::filesystem::path{};
+#endif
+}
+
+
+// Name of the CPU (brand string)
+inline std::string cpu_name()
+{
+    std::string name{};
+
+#ifdef AUTOTUNE_USE_CPUID
+    std::uint32_t regs[12]{};
+
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid( info, 0x80000000 );
+
+    if (static_cast<std::uint32_t>(info[0]) < 0x80000004)
+        return "unknown";
+
+    for (std::uint32_t i = 0x0; i < 3; i++)
+        __cpuid( reinterpret_cast<int *>(regs + 4 * i), 0x80000002 + i );
+#else
+    for (std::uint32_t i = 0x0; i < 3; i++)
+    {
+        if (__get_cpuid( 0x80000002 + i, regs + 4 * i, regs + 4 * i + 1, regs + 4 * i + 2, regs + 4 * i + 3 ) == 0)
+            return "unknown";
+    }
+#endif
+
+    name.assign( reinterpret_cast<const char *>(regs), sizeof( regs ) );
+    name.erase( name.find_last_not_of( std::string( " \0", 2 ) ) + 1 );
+    name.erase( 0, name.find_first_not_of( ' ' ) );
+#endif
+
+    return name.empty() ? "unknown" : name;
+}
+
+
+// Profile location: local (non-roaming) application data, so every host keeps its own
+inline std::filesystem::path profile_path()
+{
+#ifdef _WIN32
+    if (auto const dir = env_path( L"LOCALAPPDATA" ); !dir.empty())
+        return dir / L"LazyCRC" / L"profile.txt";
+#else
+    if (auto const dir = env_path( L"XDG_CACHE_HOME" ); !dir.empty())
+        return dir / "lazy_crc" / "profile.txt";
+
+    if (auto const dir = env_path( L"HOME" ); !dir.empty())
+        return dir / ".cache" / "lazy_crc" / "profile.txt";
+#endif
+
+    return std::filesystem::temp_directory_path() / "lazy_crc_profile.txt";
+}
+
+
+// Load the profile, false if there is none or it was tuned on another CPU
+inline bool load_profile( tune_profile & profile )
+{
+    // A profile path that can't be converted (e.g. a non-ASCII user name) only means there is no profile
+    try
+    {
+        std::ifstream file( profile_path() );
+
+        if (!file)
+            return false;
+
+        tune_profile loaded{};
+        std::string line{};
+
+        while (std::getline( file, line ))
+        {
+            auto const separator = line.find( '=' );
+
+            if (line.empty() || line[0] == ';' || separator == std::string::npos)
+                continue;
+
+            auto const key = line.substr( 0, separator );
+            auto const value = line.substr( separator + 1 );
+
+            if (key == "cpu")
+                loaded.cpu = value;
+            else if (key == "kernel")
+                loaded.kernel = value;
+            else if (key == "prefetch")
+                loaded.prefetch = std::strtoull( value.c_str(), nullptr, 10 );
+            else if (key == "block_size")
+                loaded.block_size = std::strtoull( value.c_str(), nullptr, 10 );
+        }
+
+        if (loaded.cpu != cpu_name())
+            return false;
+
+        profile = loaded;
+        return true;
+    }
+    catch (const std::filesystem::filesystem_error &)
+    {
+        return false;
+    }
+}
+
+
+// Save the profile, false on failure
+inline bool save_profile( const tune_profile & profile )
+{
+    // A profile path that can't be used fails like a profile that can't be written
+    try
+    {
+        auto const path = profile_path();
+
+        std::error_code ec;
+        std::filesystem::create_directories( path.parent_path(), ec );
+
+        std::ofstream file( path );
+
+        if (!file)
+            return false;
+
+        file << "; LazyCRC autotune profile, recreate with --autotune\n"
+            << "cpu=" << profile.cpu << "\n"
+            << "kernel=" << profile.kernel << "\n"
+            << "prefetch=" << profile.prefetch << "\n"
+            << "block_size=" << profile.block_size << "\n";
+
+        return static_cast<bool>(file);
+    }
+    catch (const std::filesystem::filesystem_error &)
+    {
+        return false;
+    }
+}
+
+
+// Throughput of reading a file with the given block size and hashing it with crc32_fast
+inline double bench_block_size( const std::filesystem::path & path, std::size_t block_size )
+{
+    double best{ 0.0 };
+    std::unique_ptr<char[]> buffer( new char[block_size] );
+
+    for (std::size_t i = 0x0; i < AUTOTUNE_REPEAT; i++)
+    {
+        std::ifstream file( path, std::ios::binary );
+        std::uint32_t crc{ 0x0 };
+        std::size_t processed{ 0x0 };
+
+        auto const time_start = std::chrono::steady_clock::now();
+
+        while (file.read( buffer.get(), block_size ) || file.gcount() > 0)
+        {
+            auto const bytes = static_cast<std::size_t>(file.gcount());
+
+            crc = crc32_fast( buffer.get(), bytes, crc );
+            processed += bytes;
+        }
+
+        auto const seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - time_start ).count();
+        m_bench_sink = crc;
+
+        if (processed / seconds / 1e9 > best)
+            best = processed / seconds / 1e9;
+    }
+
+    return best;
+}
+
+
+// Measure the kernels, look-ahead values and block sizes on this host and save the fastest ones
+inline bool run_autotune()
+{
+    tune_profile profile{};
+    profile.cpu = cpu_name();
+
+    std::vector<std::uint8_t> buffer( AUTOTUNE_KERNEL_SIZE );
+    std::mt19937 random{};
+
+    for (auto & byte : buffer)
+        byte = static_cast<std::uint8_t>(random());
+
+    // Kernels (the prefetching ones with the default look-ahead)
+    fmt::print( MSG_AUTOTUNE_SECTION, L"Kernels:" );
+
+    std::size_t count{ 0x0 };
+    auto const kernels = crc32_kernels( count );
+    double best{ 0.0 };
+
+    for (std::size_t i = 0x0; i < count; i++)
+    {
+        if (!kernels[i].available)
+            continue;
+
+        auto const gbps = bench_function( kernels[i].function, buffer.data(), buffer.size(), AUTOTUNE_DURATION, false, AUTOTUNE_REPEAT ).gbps;
+        fmt::print( MSG_AUTOTUNE_RESULT, std::wstring( kernels[i].name, kernels[i].name + std::strlen( kernels[i].name ) ), gbps );
+
+        if (gbps > best)
+        {
+            best = gbps;
+            profile.kernel = kernels[i].name;
+        }
+    }
+
+    crc32_select_kernel( profile.kernel.c_str(), false );
+
+    // Look-ahead, only matters for the prefetching kernels
+    if (profile.kernel.find( "prefetch" ) != std::string::npos)
+    {
+        fmt::print( MSG_AUTOTUNE_SECTION, L"Prefetch look-ahead:" );
+        best = 0.0;
+
+        for (auto const prefetch : AUTOTUNE_PREFETCH)
+        {
+            crc32_set_prefetch_ahead( prefetch );
+
+            auto const gbps = bench_function( crc32_fast, buffer.data(), buffer.size(), AUTOTUNE_DURATION, false, AUTOTUNE_REPEAT ).gbps;
+            fmt::print( MSG_AUTOTUNE_RESULT, fmt::format( L"{} bytes", prefetch ), gbps );
+
+            if (gbps > best)
+            {
+                best = gbps;
+                profile.prefetch = prefetch;
+            }
+        }
+    }
+
+    crc32_set_prefetch_ahead( profile.prefetch );
+
+    // Block sizes, reading a temporary file with the selected kernel
+    auto const path_temp = std::filesystem::temp_directory_path() / "lazy_crc_autotune.tmp";
+
+    {
+        std::ofstream file( path_temp, std::ios::binary );
+
+        for (std::size_t written = 0x0; file && written < AUTOTUNE_FILE_SIZE; written += buffer.size())
+            file.write( reinterpret_cast<const char *>(buffer.data()), buffer.size() );
+
+        if (!file)
+        {
+            fmt::print( MSG_ERROR_AUTOTUNE_FILE, path_to_wstring( path_temp ) );
+            return false;
+        }
+    }
+
+    fmt::print( MSG_AUTOTUNE_SECTION, L"Block sizes:" );
+    best = 0.0;
+
+    // Bring the file into the page cache first, the disk isn't what is tuned here
+    bench_block_size( path_temp, AUTOTUNE_BLOCK_SIZES[0] );
+
+    for (auto const block_size : AUTOTUNE_BLOCK_SIZES)
+    {
+        auto const gbps = bench_block_size( path_temp, block_size );
+        fmt::print( MSG_AUTOTUNE_RESULT, fmt::format( L"{} Kb", block_size / 1024 ), gbps );
+
+        if (gbps > best)
+        {
+            best = gbps;
+            profile.block_size = block_size;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove( path_temp, ec );
+
+    // Profile path for the messages, empty if it can't be found or converted
+    std::wstring profile_name{};
+
+    try
+    {
+        profile_name = path_to_wstring( profile_path() );
+    }
+    catch (const std::filesystem::filesystem_error &)
+    {
+    }
+
+    if (!save_profile( profile ))
+    {
+        fmt::print( MSG_ERROR_PROFILE_SAVE, profile_name );
+        return false;
+    }
+
+    fmt::print( MSG_AUTOTUNE_SAVED, std::wstring( profile.cpu.begin(), profile.cpu.end() ), profile_name );
+    fmt::print( MSG_INFO_PROFILE, std::wstring( profile.kernel.begin(), profile.kernel.end() ), profile.prefetch, profile.block_size );
+
+    return true;
+}
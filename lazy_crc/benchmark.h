@@ -0,0 +1,478 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+// {fmt} (https://github.com/fmtlib/fmt)
+#include <fmt/format.h>
+
+// Crc32 (https://github.com/stbrumme/crc32)
+#include <crc32/Crc32.h>
+
+// File access methods (run_io_benchmark)
+#include "io_backend.h"
+
+// Time stamp counter and cache line flushing are only available on x86 / x64
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BENCH_USE_TSC
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+// Benchmark messages
+constexpr const wchar_t * MSG_BENCH_HEADER{ L"Throughput in GB/s, {} ms per measurement\n\n{:<20}" };
+constexpr const wchar_t * MSG_BENCH_COLUMN{ L"{:>12}" };
+constexpr const wchar_t * MSG_BENCH_KERNEL{ L"\n{:<20}" };
+constexpr const wchar_t * MSG_BENCH_RESULT{ L"{:>12.2f}" };
+constexpr const wchar_t * MSG_BENCH_SUITE_KERNEL{ L"Benchmarking {}\n" };
+constexpr const wchar_t * MSG_BENCH_SUITE_SAVED{ L"\n{} measurements saved to '{}'\n" };
+constexpr const wchar_t * MSG_BENCH_REGRESSION{ L"{:<20} {:>10} B  align {}  {:<4}  prefetch {:>4}: {:>8.2f} GB/s, baseline {:>8.2f} GB/s ({:+.1f}%)\n" };
+constexpr const wchar_t * MSG_BENCH_REGRESSIONS{ L"\n{} of {} measurements are more than {}% slower than the baseline '{}'\n" };
+constexpr const wchar_t * MSG_ERROR_BENCH_FILE{ L"Unable to open the benchmark file '{}'\n" };
+constexpr const wchar_t * MSG_BENCH_IO_HEADER{ L"Reading '{}' ({} bytes, page cache warmed up), best of {} runs\n\n" };
+constexpr const wchar_t * MSG_BENCH_IO_RESULT{ L"{:<20} {:>8.2f} GB/s {:>8.2f}x\n" };
+constexpr const wchar_t * MSG_ERROR_BENCH_IO{ L"{:<20} unable to read the file\n" };
+constexpr const wchar_t * MSG_ERROR_BENCH_IO_CRC{ L"{:<20} CRC {:08X} differs from {:08X}\n" };
+
+// Time spent on every kernel / buffer size pair
+constexpr std::chrono::milliseconds BENCH_DURATION{ 100 };
+
+// Time spent on every measurement of the full suite (--benchmark-json), the best of all repetitions is kept
+constexpr std::chrono::milliseconds BENCH_SUITE_DURATION{ 4 };
+constexpr std::size_t BENCH_SUITE_REPEAT{ 5 };
+
+// Slowdown compared to the baseline which counts as a regression
+constexpr double BENCH_REGRESSION_TOLERANCE{ 0.10 };
+
+// Buffer sizes to measure, the odd sizes end with a tail that doesn't fill a whole unrolled block
+// (4 Mb + 383 bytes is how calculate_crc hands over the last chunk of most files)
+struct bench_size
+{
+    std::size_t size;
+    const wchar_t * name;
+};
+
+constexpr bench_size BENCH_SIZES[]
+{
+    { 64, L"64 B" },
+    { 383, L"383 B" },
+    { 4096, L"4 Kb" },
+    { 4096 + 383, L"4 Kb+383 B" },
+    { 4194304, L"4 Mb" },
+    { 4194304 + 383, L"4 Mb+383 B" }
+};
+
+// Full suite: 16 B to 64 Mb (powers of 4), offsets from a cache line and look-ahead of the prefetching kernels
+constexpr std::size_t BENCH_SUITE_SIZES[]{ 16, 64, 256, 1024, 4096, 16384, 65536, 262144, 1048576, 4194304, 16777216, 67108864 };
+constexpr std::size_t BENCH_SUITE_ALIGNMENTS[]{ 0, 1, 8 };
+constexpr std::size_t BENCH_SUITE_PREFETCH[]{ 64, 128, 256, 512, 1024 };
+
+// Runs per I/O backend (run_io_benchmark), the best one is kept
+constexpr std::size_t BENCH_IO_REPEAT{ 5 };
+
+// Read size of the copying backends
+constexpr std::size_t BENCH_IO_BLOCK{ 1048576 }; // 1 Mb
+
+// Keeps the compiler from dropping the CRC calculation
+inline volatile std::uint32_t m_bench_sink{ 0x0 };
+
+
+// Single measurement
+struct bench_result
+{
+    double gbps;
+    double cycles_per_byte; // time stamp counter cycles, 0 if not available
+};
+
+
+// Key of a measurement in the full suite: kernel, size, alignment, cache, prefetch
+using bench_key = std::tuple<std::string, std::size_t, std::size_t, std::string, std::size_t>;
+
+
+// Read the time stamp counter
+inline std::uint64_t bench_cycles()
+{
+#ifdef BENCH_USE_TSC
+    return __rdtsc();
+#else
+    return 0x0;
+#endif
+}
+
+
+// Evict the buffer from all cache levels
+inline void bench_evict( const std::uint8_t * data, std::size_t size )
+{
+#ifdef BENCH_USE_TSC
+    for (std::size_t i = 0x0; i < size; i += 64)
+        _mm_clflush( data + i );
+
+    _mm_clflush( data + size - 1 );
+    _mm_mfence();
+#else
+    // Touch a buffer larger than any last level cache instead
+    static std::vector<std::uint8_t> scratch( 67108864 );
+
+    for (auto & byte : scratch)
+        byte++;
+
+    static_cast<void>(data);
+    static_cast<void>(size);
+#endif
+}
+
+
+// Hash the buffer repeatedly until the duration has passed and keep the best of all repetitions,
+// a cold cache evicts the buffer before every call (not included in the result)
+template <typename Function>
+inline bench_result bench_function( Function function, const std::uint8_t * data, std::size_t size,
+    std::chrono::milliseconds duration = BENCH_DURATION, bool cold = false, std::size_t repeat = 0x1 )
+{
+    using clock = std::chrono::steady_clock;
+
+    // Calls between two clock readings, otherwise reading the clock dominates short buffers
+    std::size_t const batch = cold ? 0x1 : std::max<std::size_t>( 0x1, 65536 / size );
+
+    bench_result best{ 0.0, 0.0 };
+    std::uint32_t crc{ 0x0 };
+
+    // Warm up the caches (and the lookup tables)
+    crc = function( data, size, crc );
+
+    for (std::size_t i = 0x0; i < repeat; i++)
+    {
+        std::size_t processed{ 0x0 };
+        std::uint64_t cycles{ 0x0 };
+        clock::duration elapsed{};
+
+        auto const time_start = clock::now();
+
+        do
+        {
+            if (cold)
+                bench_evict( data, size );
+
+            auto const call_start = clock::now();
+            auto const cycles_start = bench_cycles();
+
+            for (std::size_t call = 0x0; call < batch; call++)
+                crc = function( data, size, crc );
+
+            cycles += bench_cycles() - cycles_start;
+            elapsed += clock::now() - call_start;
+            processed += size * batch;
+        }
+        while (clock::now() - time_start < duration);
+
+        auto const gbps = processed / std::chrono::duration<double>( elapsed ).count() / 1e9;
+
+        if (gbps > best.gbps)
+            best = { gbps, static_cast<double>(cycles) / processed };
+    }
+
+    m_bench_sink = crc;
+
+    return best;
+}
+
+
+// Throughput of a kernel in GB/s
+inline double bench_kernel( Crc32Function function, const std::uint8_t * data, std::size_t size )
+{
+    return bench_function( function, data, size ).gbps;
+}
+
+
+// Measure the throughput of all available CRC32 kernels (or just the selected one)
+inline void run_benchmark( std::string_view only_kernel )
+{
+    // Random data for the largest size
+    std::vector<std::uint8_t> buffer( BENCH_SIZES[std::size( BENCH_SIZES ) - 1].size );
+    std::mt19937 random{};
+
+    for (auto & byte : buffer)
+        byte = static_cast<std::uint8_t>(random());
+
+    fmt::print( MSG_BENCH_HEADER, BENCH_DURATION.count(), L"kernel" );
+
+    for (auto const& size : BENCH_SIZES)
+        fmt::print( MSG_BENCH_COLUMN, size.name );
+
+    // crc32_fast adds the size-class dispatch on top of the kernel
+    auto const fast = crc32_selected_kernel();
+
+    std::size_t count{ 0x0 };
+    auto const kernels = crc32_kernels( count );
+
+    for (std::size_t i = 0x0; i < count; i++)
+    {
+        if (!kernels[i].available || (!only_kernel.empty() && only_kernel != kernels[i].name))
+            continue;
+
+        fmt::print( MSG_BENCH_KERNEL, std::wstring( kernels[i].name, kernels[i].name + std::strlen( kernels[i].name ) ) );
+
+        for (auto const& size : BENCH_SIZES)
+            fmt::print( MSG_BENCH_RESULT, bench_kernel( kernels[i].function, buffer.data(), size.size ) );
+    }
+
+    fmt::print( MSG_BENCH_KERNEL, L"crc32_fast (" + std::wstring( fast, fast + std::strlen( fast ) ) + L")" );
+
+    for (auto const& size : BENCH_SIZES)
+        fmt::print( MSG_BENCH_RESULT, bench_kernel( crc32_fast, buffer.data(), size.size ) );
+
+    fmt::print( L"\n" );
+}
+
+
+// Compare the results to a baseline saved by an earlier run, returns the number of regressions
+inline std::size_t compare_benchmark( const std::map<bench_key, bench_result> & results, const std::filesystem::path & path_baseline )
+{
+    std::ifstream baseline( path_baseline );
+
+    if (!baseline)
+    {
+        fmt::print( MSG_ERROR_BENCH_FILE, path_to_wstring( path_baseline ) );
+        return 0x0;
+    }
+
+    // The JSON file holds one measurement per line
+    std::regex const pattern( R"re("kernel": "([^"]+)", "size": (\d+), "alignment": (\d+), "cache": "(\w+)", "prefetch": (\d+), "gbps": ([0-9.]+))re" );
+    std::size_t regressions{ 0x0 }, compared{ 0x0 };
+    std::string line{};
+
+    while (std::getline( baseline, line ))
+    {
+        std::smatch match{};
+
+        if (!std::regex_search( line, match, pattern ))
+            continue;
+
+        bench_key const key{ match[1], std::stoull( match[2] ), std::stoull( match[3] ), match[4], std::stoull( match[5] ) };
+        auto const found = results.find( key );
+
+        if (found == results.end())
+            continue;
+
+        compared++;
+
+        auto const before = std::stod( match[6] );
+        auto const after = found->second.gbps;
+
+        if (after < before * (1.0 - BENCH_REGRESSION_TOLERANCE))
+        {
+            regressions++;
+
+            auto const & name = std::get<0>( key );
+            fmt::print( MSG_BENCH_REGRESSION, std::wstring( name.begin(), name.end() ), std::get<1>( key ), std::get<2>( key ),
+                (std::get<3>( key ) == "cold") ? L"cold" : L"hot", std::get<4>( key ), after, before, (after / before - 1.0) * 100.0 );
+        }
+    }
+
+    fmt::print( MSG_BENCH_REGRESSIONS, regressions, compared, BENCH_REGRESSION_TOLERANCE * 100.0, path_to_wstring( path_baseline ) );
+
+    return regressions;
+}
+
+
+// Run the full suite over all available kernels (or just the selected one) and save it as JSON,
+// returns the number of regressions compared to the baseline (if any)
+inline std::size_t run_benchmark_suite( std::string_view only_kernel, const std::filesystem::path & path_json,
+    const std::filesystem::path & path_baseline )
+{
+    // Random data for the largest size, the base is aligned to a cache line
+    std::vector<std::uint8_t> buffer( BENCH_SUITE_SIZES[std::size( BENCH_SUITE_SIZES ) - 1] + 128 );
+    std::mt19937 random{};
+
+    for (auto & byte : buffer)
+        byte = static_cast<std::uint8_t>(random());
+
+    auto const base = buffer.data() + (64 - reinterpret_cast<std::uintptr_t>(buffer.data()) % 64) % 64;
+
+    std::ofstream json( path_json );
+
+    if (!json)
+    {
+        fmt::print( MSG_ERROR_BENCH_FILE, path_to_wstring( path_json ) );
+        return 0x0;
+    }
+
+    std::map<bench_key, bench_result> results{};
+
+    // Measure one kernel (with one look-ahead) over all sizes, alignments and both cache states
+    auto measure = [&] ( const std::string & name, std::size_t prefetch, auto function )
+    {
+        for (auto const size : BENCH_SUITE_SIZES)
+        {
+            for (auto const alignment : BENCH_SUITE_ALIGNMENTS)
+            {
+                for (auto const cold : { false, true })
+                {
+                    results[{ name, size, alignment, cold ? "cold" : "hot", prefetch }] =
+                        bench_function( function, base + alignment, size, BENCH_SUITE_DURATION, cold, BENCH_SUITE_REPEAT );
+                }
+            }
+        }
+    };
+
+    std::size_t count{ 0x0 };
+    auto const kernels = crc32_kernels( count );
+
+    for (std::size_t i = 0x0; i < count; i++)
+    {
+        std::string const name = kernels[i].name;
+
+        if (!kernels[i].available || (!only_kernel.empty() && only_kernel != name))
+            continue;
+
+        fmt::print( MSG_BENCH_SUITE_KERNEL, std::wstring( name.begin(), name.end() ) );
+
+        // The prefetching kernels are measured with every look-ahead
+        if (name == "16bytes_prefetch" || name == "2x16bytes_prefetch")
+        {
+            auto const prefetch_function = (name == "16bytes_prefetch") ? crc32_16bytes_prefetch : crc32_2x16bytes_prefetch;
+
+            for (auto const prefetch : BENCH_SUITE_PREFETCH)
+            {
+                measure( name, prefetch, [=] ( const void * data, std::size_t length, std::uint32_t crc )
+                {
+                    return prefetch_function( data, length, crc, prefetch );
+                });
+            }
+        }
+        else
+            measure( name, 0x0, kernels[i].function );
+    }
+
+    if (only_kernel.empty())
+    {
+        fmt::print( MSG_BENCH_SUITE_KERNEL, L"crc32_fast" );
+        measure( "fast", 0x0, crc32_fast );
+    }
+
+    json << "{\n  \"selected_kernel\": \"" << crc32_selected_kernel() << "\",\n  \"results\": [\n";
+
+    std::size_t written{ 0x0 };
+
+    for (auto const& [key, result] : results)
+    {
+        json << fmt::format( "    {{ \"kernel\": \"{}\", \"size\": {}, \"alignment\": {}, \"cache\": \"{}\", \"prefetch\": {}, "
+            "\"gbps\": {:.4f}, \"cycles_per_byte\": {:.4f} }}{}\n",
+            std::get<0>( key ), std::get<1>( key ), std::get<2>( key ), std::get<3>( key ), std::get<4>( key ),
+            result.gbps, result.cycles_per_byte, (++written < results.size()) ? "," : "" );
+    }
+
+    json << "  ]\n}\n";
+    json.close();
+
+    fmt::print( MSG_BENCH_SUITE_SAVED, results.size(), path_to_wstring( path_json ) );
+
+    if (path_baseline.empty())
+        return 0x0;
+
+    return compare_benchmark( results, path_baseline );
+}
+
+
+// Hash the file once with the backend, false on failure
+inline bool bench_io_file( io_backend & backend, const std::filesystem::path & path, std::vector<std::uint8_t> & buffer, std::uint32_t & crc )
+{
+    auto file = backend.open( path );
+    std::uint64_t size{ 0x0 };
+
+    if (!file || !file->size( size ))
+        return false;
+
+    crc = 0x0;
+
+    if (file->has_views())
+        return file->read_view( 0x0, size, [&crc] ( const void * data, std::size_t length ) { crc = crc32_fast( data, length, crc ); } );
+
+    for (std::uint64_t offset = 0x0; offset < size; )
+    {
+        auto const bytes = file->read_at( buffer.data(), buffer.size(), offset );
+
+        if (bytes == IO_ERROR || bytes == 0x0)
+            return false;
+
+        crc = crc32_fast( buffer.data(), bytes, crc );
+        offset += bytes;
+    }
+
+    return true;
+}
+
+
+// Compare the throughput of all I/O backends on one file, relative to the default (copying) backend,
+// false if a backend fails or gets another CRC
+inline bool run_io_benchmark( const std::filesystem::path & path )
+{
+    std::error_code ec;
+    auto const size = std::filesystem::file_size( path, ec );
+
+    if (ec)
+    {
+        fmt::print( MSG_ERROR_BENCH_FILE, path_to_wstring( path ) );
+        return false;
+    }
+
+    fmt::print( MSG_BENCH_IO_HEADER, path_to_wstring( path ), size, BENCH_IO_REPEAT );
+
+    std::vector<std::uint8_t> buffer( BENCH_IO_BLOCK );
+    double baseline{ 0.0 };
+    std::uint32_t expected{ 0x0 };
+    bool result{ true };
+
+    for (auto const name : IO_BACKENDS)
+    {
+        auto backend = make_io_backend( name );
+        std::uint32_t crc{ 0x0 };
+
+        // The first run brings the file into the page cache, the disk isn't what is compared here
+        if (!backend || !bench_io_file( *backend, path, buffer, crc ))
+        {
+            fmt::print( MSG_ERROR_BENCH_IO, name );
+            result = false;
+
+            continue;
+        }
+
+        if (name == IO_BACKENDS[0])
+            expected = crc;
+        else if (crc != expected)
+        {
+            fmt::print( MSG_ERROR_BENCH_IO_CRC, name, crc, expected );
+            result = false;
+        }
+
+        double best{ 0.0 };
+
+        for (std::size_t i = 0x0; i < BENCH_IO_REPEAT; i++)
+        {
+            auto const time_start = std::chrono::steady_clock::now();
+            bench_io_file( *backend, path, buffer, crc );
+            auto const seconds = std::chrono::duration<double>( std::chrono::steady_clock::now() - time_start ).count();
+
+            best = std::max( best, size / seconds / 1e9 );
+        }
+
+        if (name == IO_BACKENDS[0])
+            baseline = best;
+
+        fmt::print( MSG_BENCH_IO_RESULT, name, best, (baseline > 0.0) ? best / baseline : 0.0 );
+    }
+
+    return result;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+// File access methods (io_file::advise)
+#include "io_backend.h"
+
+// Read-ahead hinted in front of the hashed position with --cache-policy=drop
+constexpr std::uint64_t CACHE_WILLNEED_WINDOW{ 33554432 }; // 32 Mb
+
+// What is left in the page cache of the files hashed (--cache-policy)
+enum class cache_policy
+{
+    keep, // the kernel decides, files stay cached after hashing
+    drop  // read-ahead hints in front of hashing, every range dropped once it was hashed
+};
+
+// Page cache in use (--cache-policy)
+inline cache_policy m_cache_policy{ cache_policy::keep };
+
+// Bytes dropped from the page cache so far (the kernel accepted the hint)
+inline std::atomic<std::uint64_t> m_cache_dropped{ 0x0 };
+
+
+// Parse the cache policy name, false if unknown
+inline bool parse_cache_policy( std::wstring_view name, cache_policy & policy )
+{
+    if (name == L"keep")
+        policy = cache_policy::keep;
+    else if (name == L"drop")
+        policy = cache_policy::drop;
+    else
+        return false;
+
+    return true;
+}
+
+
+// Page cache hints for a range of a file read in order (the whole file or a segment): the sequential hint, and with
+// cache_policy::drop WILLNEED up to CACHE_WILLNEED_WINDOW ahead and DONTNEED behind the hashed position. The last range
+// hashed is dropped only with the next one (or on destruction), the mmap backend unmaps a view after it was hashed
+class cache_tracker
+{
+public:
+    cache_tracker( io_file & file, cache_policy policy, std::uint64_t start = 0x0 )
+        : m_file( file ), m_policy( policy ), m_start( start ), m_position( start ), m_dropped( start ), m_hinted( start )
+    {
+        m_file.advise( io_advice::sequential );
+
+        if (m_policy == cache_policy::drop)
+            prefetch();
+    }
+
+    ~cache_tracker() { drop( m_position ); }
+
+    cache_tracker( const cache_tracker & ) = delete;
+    cache_tracker & operator=( const cache_tracker & ) = delete;
+
+    // The next length bytes were hashed
+    void consumed( std::size_t length )
+    {
+        if (m_policy != cache_policy::drop)
+            return;
+
+        drop( m_position );
+        m_position += length;
+
+        if (m_position + CACHE_WILLNEED_WINDOW / 2 > m_hinted)
+            prefetch();
+    }
+
+private:
+    void prefetch()
+    {
+        auto const start = std::max( m_hinted, m_position );
+
+        m_file.advise( io_advice::willneed, start, CACHE_WILLNEED_WINDOW );
+        m_hinted = start + CACHE_WILLNEED_WINDOW;
+    }
+
+    void drop( std::uint64_t end )
+    {
+        if (m_policy != cache_policy::drop || end <= m_dropped)
+            return;
+
+        // Always from the start: the kernel skips large folios (read-ahead) reaching into the range from before it,
+        // the part dropped already is empty and cheap to walk
+        if (m_file.advise( io_advice::dontneed, m_start, end - m_start ))
+            m_cache_dropped += end - m_dropped;
+
+        m_dropped = end;
+    }
+
+    io_file & m_file;
+    cache_policy m_policy;
+
+    // Start of the range, hashed up to, dropped up to, read-ahead hinted up to
+    std::uint64_t m_start, m_position, m_dropped, m_hinted;
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Directory entries read per system call (getdents64), thousands of them at once
+constexpr std::size_t WALK_BUFFER{ 1048576 }; // 1 Mb
+
+// Size of a file the listing doesn't tell (getdents64), the file is opened anyway
+constexpr std::uint64_t WALK_SIZE_UNKNOWN{ std::numeric_limits<std::uint64_t>::max() };
+
+// Entry of a directory: a regular file (symbolic links to one included) or a subdirectory (symbolic links and
+// junctions to one are not followed, as with std::filesystem::recursive_directory_iterator)
+struct walk_entry
+{
+    std::filesystem::path path;
+    bool directory;
+    std::uint64_t size; // WALK_SIZE_UNKNOWN if the listing doesn't have it
+};
+
+
+// List the files and subdirectories of the directory in the order of the file system, without a stat() per entry
+// where the listing has the type already. False if it can't be read (the entries read so far are kept)
+inline bool list_directory( const std::filesystem::path & path_dir, std::vector<walk_entry> & entries )
+{
+#ifdef _WIN32
+    // No short names and larger batches, the sizes come with the listing
+    WIN32_FIND_DATAW data{};
+    auto const find = ::FindFirstFileExW( (path_dir / L"*").c_str(), FindExInfoBasic, &data, FindExSearchNameMatch,
+        nullptr, FIND_FIRST_EX_LARGE_FETCH );
+
+    if (find == INVALID_HANDLE_VALUE)
+        return false;
+
+    do
+    {
+        std::wstring_view const name( data.cFileName );
+
+        if (name == L"." || name == L"..")
+            continue;
+
+        auto const reparse = (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) != 0x0;
+
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        {
+            if (!reparse)
+                entries.push_back( { path_dir / name, true, 0x0 } );
+        }
+        else if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DEVICE))
+        {
+            // The size of a symbolic link is its own, not the one of its target
+            auto const size = reparse ? WALK_SIZE_UNKNOWN : (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+            entries.push_back( { path_dir / name, false, size } );
+        }
+    }
+    while (::FindNextFileW( find, &data ));
+
+    auto const result = ::GetLastError() == ERROR_NO_MORE_FILES;
+    ::FindClose( find );
+
+    return result;
+#elif defined(__linux__)
+    int const dir = ::open( path_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+
+    if (dir == -1)
+        return false;
+
+    // Layout of the records returned by getdents64 (struct linux_dirent64)
+    struct dirent64_record
+    {
+        std::uint64_t d_ino;
+        std::int64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[1];
+    };
+
+    static thread_local std::vector<char> buffer( WALK_BUFFER );
+    bool result{ true };
+
+    for (;;)
+    {
+        auto const bytes = ::syscall( SYS_getdents64, dir, buffer.data(), buffer.size() );
+
+        if (bytes <= 0)
+        {
+            result = (bytes == 0);
+            break;
+        }
+
+        for (long position = 0x0; position < bytes; )
+        {
+            auto const record = reinterpret_cast<const dirent64_record *>(buffer.data() + position);
+            position += record->d_reclen;
+
+            const char * name = record->d_name;
+
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            auto type = record->d_type;
+            auto size = WALK_SIZE_UNKNOWN;
+            struct stat info{};
+
+            // Only file systems without types in their listing need a stat() per entry
+            if (type == DT_UNKNOWN)
+            {
+                if (::fstatat( dir, name, &info, AT_SYMLINK_NOFOLLOW ) != 0)
+                    continue;
+
+                type = S_ISDIR( info.st_mode ) ? DT_DIR : S_ISREG( info.st_mode ) ? DT_REG : S_ISLNK( info.st_mode ) ? DT_LNK : DT_UNKNOWN;
+                size = static_cast<std::uint64_t>(info.st_size);
+            }
+
+            // Symbolic links count for the file they point to
+            if (type == DT_LNK)
+            {
+                if (::fstatat( dir, name, &info, 0x0 ) != 0 || !S_ISREG( info.st_mode ))
+                    continue;
+
+                type = DT_REG;
+                size = static_cast<std::uint64_t>(info.st_size);
+            }
+
+            if (type == DT_DIR || type == DT_REG)
+                entries.push_back( { path_dir / name, type == DT_DIR, size } );
+        }
+    }
+
+    ::close( dir );
+    return result;
+#else
+    std::error_code ec;
+
+    for (auto const & entry : std::filesystem::directory_iterator( path_dir, ec ))
+    {
+        if (entry.is_directory( ec ) && !entry.is_symlink( ec ))
+            entries.push_back( { entry.path(), true, 0x0 } );
+        else if (entry.is_regular_file( ec ))
+            entries.push_back( { entry.path(), false, WALK_SIZE_UNKNOWN } );
+    }
+
+    return !ec;
+#endif
+}
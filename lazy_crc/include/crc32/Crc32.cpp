@@ -18,6 +18,13 @@
 
 
 #include "Crc32.h"
+// CRC32C tables
+#include "CrcEngine.h"
+
+// std::atomic
+#include <atomic>
+// strcmp
+#include <cstring>
 
 #ifndef __LITTLE_ENDIAN
   #define __LITTLE_ENDIAN 1234
@@ -56,6 +63,20 @@
 #error undefined byte order, compile with -D__BYTE_ORDER=1234 (if little endian) or -D__BYTE_ORDER=4321 (big endian)
 #endif
 
+// SSE4.2 / carry-less multiplication intrinsics and cpuid
+#ifdef CRC32_USE_SSE42
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    // MSVC allows intrinsics without any additional compiler switches
+    #define CRC32_TARGET(features)
+  #else
+    #include <cpuid.h>
+    // GCC / Clang need the instruction set enabled per function
+    #define CRC32_TARGET(features) __attribute__((target(features)))
+  #endif
+#endif
+
 
 namespace
 {
@@ -88,6 +109,54 @@ namespace
     #define NO_LUT // don't need Crc32Lookup at all
   #endif
 
+  /// multiply two polynomials modulo Polynomial (bit-reflected: x^0 is the highest bit)
+  static inline constexpr uint32_t multiplyModP(uint32_t a, uint32_t b)
+  {
+    uint32_t product = 0;
+    for (uint32_t mask = 1u << 31; mask != 0; mask >>= 1)
+    {
+      if (a & mask)
+      {
+        product ^= b;
+        // no more bits left in a
+        if ((a & (mask - 1)) == 0)
+          break;
+      }
+      // b *= x
+      b = (b >> 1) ^ ((0 - (b & 1)) & Polynomial);
+    }
+
+    return product;
+  }
+
+  /// x^(2^k) mod Polynomial for k = 0..31
+  struct PowersOfTwo
+  {
+    uint32_t power[32];
+
+    constexpr PowersOfTwo() : power()
+    {
+      power[0] = 1u << 30; // x^1
+      for (int k = 1; k < 32; k++)
+        power[k] = multiplyModP(power[k - 1], power[k - 1]);
+    }
+  };
+
+  /// computed at compile time, the multiplicative order of x divides 2^32 - 1, therefore x^(2^32) = x^(2^0)
+  constexpr PowersOfTwo X2n{};
+
+  /// x^(8*numBytes) mod Polynomial, appending numBytes zeros to a CRC is a multiplication by it
+  static inline uint32_t zerosOperator(size_t numBytes)
+  {
+    uint32_t result = 1u << 31; // x^0
+    // start at x^8 = x^(2^3) (one byte)
+    for (unsigned int k = 3; numBytes != 0; numBytes >>= 1, k++)
+      if (numBytes & 1)
+        result = multiplyModP(X2n.power[k & 31], result);
+
+    return result;
+  }
+
 } // anonymous namespace
 
 #ifndef NO_LUT
@@ -380,6 +449,66 @@ uint32_t crc32_4x8bytes(const void* data, size_t length, uint32_t previousCrc32)
 
 
 #ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+namespace
+{
+    /// process 16 bytes (Slicing-by-16), BigEndian: the words were loaded by a big endian CPU (most significant byte first)
+    template <bool BigEndian>
+    inline uint32_t slice16_order( uint32_t crc, const uint32_t * current )
+    {
+        if (BigEndian)
+        {
+            uint32_t one = current[0] ^ swap( crc );
+            uint32_t two = current[1];
+            uint32_t three = current[2];
+            uint32_t four = current[3];
+            return Crc32Lookup[0][four & 0xFF] ^
+                Crc32Lookup[1][(four >> 8) & 0xFF] ^
+                Crc32Lookup[2][(four >> 16) & 0xFF] ^
+                Crc32Lookup[3][(four >> 24) & 0xFF] ^
+                Crc32Lookup[4][three & 0xFF] ^
+                Crc32Lookup[5][(three >> 8) & 0xFF] ^
+                Crc32Lookup[6][(three >> 16) & 0xFF] ^
+                Crc32Lookup[7][(three >> 24) & 0xFF] ^
+                Crc32Lookup[8][two & 0xFF] ^
+                Crc32Lookup[9][(two >> 8) & 0xFF] ^
+                Crc32Lookup[10][(two >> 16) & 0xFF] ^
+                Crc32Lookup[11][(two >> 24) & 0xFF] ^
+                Crc32Lookup[12][one & 0xFF] ^
+                Crc32Lookup[13][(one >> 8) & 0xFF] ^
+                Crc32Lookup[14][(one >> 16) & 0xFF] ^
+                Crc32Lookup[15][(one >> 24) & 0xFF];
+        }
+
+        uint32_t one = current[0] ^ crc;
+        uint32_t two = current[1];
+        uint32_t three = current[2];
+        uint32_t four = current[3];
+        return Crc32Lookup[0][(four >> 24) & 0xFF] ^
+            Crc32Lookup[1][(four >> 16) & 0xFF] ^
+            Crc32Lookup[2][(four >> 8) & 0xFF] ^
+            Crc32Lookup[3][four & 0xFF] ^
+            Crc32Lookup[4][(three >> 24) & 0xFF] ^
+            Crc32Lookup[5][(three >> 16) & 0xFF] ^
+            Crc32Lookup[6][(three >> 8) & 0xFF] ^
+            Crc32Lookup[7][three & 0xFF] ^
+            Crc32Lookup[8][(two >> 24) & 0xFF] ^
+            Crc32Lookup[9][(two >> 16) & 0xFF] ^
+            Crc32Lookup[10][(two >> 8) & 0xFF] ^
+            Crc32Lookup[11][two & 0xFF] ^
+            Crc32Lookup[12][(one >> 24) & 0xFF] ^
+            Crc32Lookup[13][(one >> 16) & 0xFF] ^
+            Crc32Lookup[14][(one >> 8) & 0xFF] ^
+            Crc32Lookup[15][one & 0xFF];
+    }
+
+    /// process 16 bytes (Slicing-by-16) in the byte order of this CPU, the steps of all slicing-by-16 kernels
+    inline uint32_t slice16( uint32_t crc, const uint32_t * current )
+    {
+        return slice16_order<__BYTE_ORDER == __BIG_ENDIAN>( crc, current );
+    }
+} // anonymous namespace
+
+
 /// compute CRC32 (Slicing-by-16 algorithm)
 uint32_t crc32_16bytes(const void* data, size_t length, uint32_t previousCrc32)
 {
@@ -394,62 +523,41 @@ uint32_t crc32_16bytes(const void* data, size_t length, uint32_t previousCrc32)
   {
     for (size_t unrolling = 0; unrolling < Unroll; unrolling++)
     {
-#if __BYTE_ORDER == __BIG_ENDIAN
-    uint32_t one   = *current++ ^ swap(crc);
-    uint32_t two   = *current++;
-    uint32_t three = *current++;
-    uint32_t four  = *current++;
-    crc  = Crc32Lookup[ 0][ four         & 0xFF] ^
-           Crc32Lookup[ 1][(four  >>  8) & 0xFF] ^
-           Crc32Lookup[ 2][(four  >> 16) & 0xFF] ^
-           Crc32Lookup[ 3][(four  >> 24) & 0xFF] ^
-           Crc32Lookup[ 4][ three        & 0xFF] ^
-           Crc32Lookup[ 5][(three >>  8) & 0xFF] ^
-           Crc32Lookup[ 6][(three >> 16) & 0xFF] ^
-           Crc32Lookup[ 7][(three >> 24) & 0xFF] ^
-           Crc32Lookup[ 8][ two          & 0xFF] ^
-           Crc32Lookup[ 9][(two   >>  8) & 0xFF] ^
-           Crc32Lookup[10][(two   >> 16) & 0xFF] ^
-           Crc32Lookup[11][(two   >> 24) & 0xFF] ^
-           Crc32Lookup[12][ one          & 0xFF] ^
-           Crc32Lookup[13][(one   >>  8) & 0xFF] ^
-           Crc32Lookup[14][(one   >> 16) & 0xFF] ^
-           Crc32Lookup[15][(one   >> 24) & 0xFF];
-#else
-    uint32_t one   = *current++ ^ crc;
-    uint32_t two   = *current++;
-    uint32_t three = *current++;
-    uint32_t four  = *current++;
-    crc  = Crc32Lookup[ 0][(four  >> 24) & 0xFF] ^
-           Crc32Lookup[ 1][(four  >> 16) & 0xFF] ^
-           Crc32Lookup[ 2][(four  >>  8) & 0xFF] ^
-           Crc32Lookup[ 3][ four         & 0xFF] ^
-           Crc32Lookup[ 4][(three >> 24) & 0xFF] ^
-           Crc32Lookup[ 5][(three >> 16) & 0xFF] ^
-           Crc32Lookup[ 6][(three >>  8) & 0xFF] ^
-           Crc32Lookup[ 7][ three        & 0xFF] ^
-           Crc32Lookup[ 8][(two   >> 24) & 0xFF] ^
-           Crc32Lookup[ 9][(two   >> 16) & 0xFF] ^
-           Crc32Lookup[10][(two   >>  8) & 0xFF] ^
-           Crc32Lookup[11][ two          & 0xFF] ^
-           Crc32Lookup[12][(one   >> 24) & 0xFF] ^
-           Crc32Lookup[13][(one   >> 16) & 0xFF] ^
-           Crc32Lookup[14][(one   >>  8) & 0xFF] ^
-           Crc32Lookup[15][ one          & 0xFF];
-#endif
+      crc = slice16(crc, current);
+      current += 4;
     }
 
     length -= BytesAtOnce;
   }
 
+  // remaining 16 to 63 bytes, one slice at a time
+  while (length >= 16)
+  {
+    crc = slice16(crc, current);
+    current += 4;
+    length  -= 16;
+  }
+
   const uint8_t* currentChar = (const uint8_t*) current;
-  // remaining 1 to 63 bytes (standard algorithm)
+  // remaining 1 to 15 bytes (standard algorithm)
   while (length-- != 0)
     crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *currentChar++];
 
   return ~crc; // same as crc ^ 0xFFFFFFFF
 }
 
+/// Slicing-by-16 as run on big endian CPUs, on words holding the data most significant byte first
+uint32_t crc32_16bytes_big_endian(const uint32_t* words, size_t length, uint32_t previousCrc32)
+{
+  uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+
+  // whole 16 byte slices only
+  for (; length >= 16; length -= 16, words += 4)
+    crc = slice16_order<true>(crc, words);
+
+  return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
 /// compute CRC32 (Slicing-by-8 algorithm) //////////////////////////////////////////////////////////////////////////////////////////
 uint32_t crc32_2x16bytes( const void * data, size_t length, uint32_t previousCrc32 )
 {
@@ -465,61 +573,18 @@ uint32_t crc32_2x16bytes( const void * data, size_t length, uint32_t previousCrc
     {
         for (size_t unrolling = 0; unrolling < Unroll; unrolling++)
         {
-            {
-                uint32_t one = *current++ ^ crc;
-                uint32_t two = *current++;
-                uint32_t a3 = *current++;
-                uint32_t a4 = *current++;
-                crc = Crc32Lookup[0][(a4 >> 24) & 0xFF] ^
-                    Crc32Lookup[1][(a4 >> 16) & 0xFF] ^
-                    Crc32Lookup[2][(a4 >> 8) & 0xFF] ^
-                    Crc32Lookup[3][a4 & 0xFF] ^
-                    Crc32Lookup[4][(a3 >> 24) & 0xFF] ^
-                    Crc32Lookup[5][(a3 >> 16) & 0xFF] ^
-                    Crc32Lookup[6][(a3 >> 8) & 0xFF] ^
-                    Crc32Lookup[7][a3 & 0xFF] ^
-                    Crc32Lookup[8][(two >> 24) & 0xFF] ^
-                    Crc32Lookup[9][(two >> 16) & 0xFF] ^
-                    Crc32Lookup[10][(two >> 8) & 0xFF] ^
-                    Crc32Lookup[11][two & 0xFF] ^
-                    Crc32Lookup[12][(one >> 24) & 0xFF] ^
-                    Crc32Lookup[13][(one >> 16) & 0xFF] ^
-                    Crc32Lookup[14][(one >> 8) & 0xFF] ^
-                    Crc32Lookup[15][one & 0xFF];
-            }
-            {
-                uint32_t one = *current++ ^ crc;
-                uint32_t two = *current++;
-                uint32_t a3 = *current++;
-                uint32_t a4 = *current++;
-                crc = Crc32Lookup[0][(a4 >> 24) & 0xFF] ^
-                    Crc32Lookup[1][(a4 >> 16) & 0xFF] ^
-                    Crc32Lookup[2][(a4 >> 8) & 0xFF] ^
-                    Crc32Lookup[3][a4 & 0xFF] ^
-                    Crc32Lookup[4][(a3 >> 24) & 0xFF] ^
-                    Crc32Lookup[5][(a3 >> 16) & 0xFF] ^
-                    Crc32Lookup[6][(a3 >> 8) & 0xFF] ^
-                    Crc32Lookup[7][a3 & 0xFF] ^
-                    Crc32Lookup[8][(two >> 24) & 0xFF] ^
-                    Crc32Lookup[9][(two >> 16) & 0xFF] ^
-                    Crc32Lookup[10][(two >> 8) & 0xFF] ^
-                    Crc32Lookup[11][two & 0xFF] ^
-                    Crc32Lookup[12][(one >> 24) & 0xFF] ^
-                    Crc32Lookup[13][(one >> 16) & 0xFF] ^
-                    Crc32Lookup[14][(one >> 8) & 0xFF] ^
-                    Crc32Lookup[15][one & 0xFF];
-            }
+            // two Slicing-by-16 steps (slice16 takes care of big endian CPUs)
+            crc = slice16( crc, current );
+            current += 4;
+            crc = slice16( crc, current );
+            current += 4;
         }
 
         length -= BytesAtOnce;
     }
 
-    const uint8_t * currentChar = (const uint8_t *) current;
-    // remaining 1 to 7 bytes (standard algorithm)
-    while (length-- > 0)
-        crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *currentChar++];
-
-    return ~crc; // same as crc ^ 0xFFFFFFFF
+    // remaining 1 to 127 bytes
+    return crc32_16bytes( current, length, ~crc );
 }
 
 /// compute CRC32 (Slicing-by-16 algorithm, prefetch upcoming data blocks)
@@ -541,60 +606,15 @@ uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previo
 
     for (size_t unrolling = 0; unrolling < Unroll; unrolling++)
     {
-#if __BYTE_ORDER == __BIG_ENDIAN
-    uint32_t one   = *current++ ^ swap(crc);
-    uint32_t two   = *current++;
-    uint32_t three = *current++;
-    uint32_t four  = *current++;
-    crc  = Crc32Lookup[ 0][ four         & 0xFF] ^
-           Crc32Lookup[ 1][(four  >>  8) & 0xFF] ^
-           Crc32Lookup[ 2][(four  >> 16) & 0xFF] ^
-           Crc32Lookup[ 3][(four  >> 24) & 0xFF] ^
-           Crc32Lookup[ 4][ three        & 0xFF] ^
-           Crc32Lookup[ 5][(three >>  8) & 0xFF] ^
-           Crc32Lookup[ 6][(three >> 16) & 0xFF] ^
-           Crc32Lookup[ 7][(three >> 24) & 0xFF] ^
-           Crc32Lookup[ 8][ two          & 0xFF] ^
-           Crc32Lookup[ 9][(two   >>  8) & 0xFF] ^
-           Crc32Lookup[10][(two   >> 16) & 0xFF] ^
-           Crc32Lookup[11][(two   >> 24) & 0xFF] ^
-           Crc32Lookup[12][ one          & 0xFF] ^
-           Crc32Lookup[13][(one   >>  8) & 0xFF] ^
-           Crc32Lookup[14][(one   >> 16) & 0xFF] ^
-           Crc32Lookup[15][(one   >> 24) & 0xFF];
-#else
-    uint32_t one   = *current++ ^ crc;
-    uint32_t two   = *current++;
-    uint32_t three = *current++;
-    uint32_t four  = *current++;
-    crc  = Crc32Lookup[ 0][(four  >> 24) & 0xFF] ^
-           Crc32Lookup[ 1][(four  >> 16) & 0xFF] ^
-           Crc32Lookup[ 2][(four  >>  8) & 0xFF] ^
-           Crc32Lookup[ 3][ four         & 0xFF] ^
-           Crc32Lookup[ 4][(three >> 24) & 0xFF] ^
-           Crc32Lookup[ 5][(three >> 16) & 0xFF] ^
-           Crc32Lookup[ 6][(three >>  8) & 0xFF] ^
-           Crc32Lookup[ 7][ three        & 0xFF] ^
-           Crc32Lookup[ 8][(two   >> 24) & 0xFF] ^
-           Crc32Lookup[ 9][(two   >> 16) & 0xFF] ^
-           Crc32Lookup[10][(two   >>  8) & 0xFF] ^
-           Crc32Lookup[11][ two          & 0xFF] ^
-           Crc32Lookup[12][(one   >> 24) & 0xFF] ^
-           Crc32Lookup[13][(one   >> 16) & 0xFF] ^
-           Crc32Lookup[14][(one   >>  8) & 0xFF] ^
-           Crc32Lookup[15][ one          & 0xFF];
-#endif
+      crc = slice16(crc, current);
+      current += 4;
     }
 
     length -= BytesAtOnce;
   }
 
-  const uint8_t* currentChar = (const uint8_t*) current;
-  // remaining 1 to 63 bytes (standard algorithm)
-  while (length-- != 0)
-    crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *currentChar++];
-
-  return ~crc; // same as crc ^ 0xFFFFFFFF
+  // remaining bytes, including the last prefetchAhead bytes (no need to prefetch those)
+  return crc32_16bytes(current, length, ~crc);
 }
 
 /// compute CRC32 (Slicing-by-8 algorithm) //////////////////////////////////////////////////////////////////////////////////////////
@@ -617,87 +637,760 @@ uint32_t crc32_2x16bytes_prefetch( const void * data, size_t length, uint32_t pr
 
         for (size_t unrolling = 0; unrolling < Unroll; unrolling++)
         {
-            {
-                uint32_t one = *current++ ^ crc;
-                uint32_t two = *current++;
-                uint32_t a3 = *current++;
-                uint32_t a4 = *current++;
-                crc = Crc32Lookup[0][(a4 >> 24) & 0xFF] ^
-                    Crc32Lookup[1][(a4 >> 16) & 0xFF] ^
-                    Crc32Lookup[2][(a4 >> 8) & 0xFF] ^
-                    Crc32Lookup[3][a4 & 0xFF] ^
-                    Crc32Lookup[4][(a3 >> 24) & 0xFF] ^
-                    Crc32Lookup[5][(a3 >> 16) & 0xFF] ^
-                    Crc32Lookup[6][(a3 >> 8) & 0xFF] ^
-                    Crc32Lookup[7][a3 & 0xFF] ^
-                    Crc32Lookup[8][(two >> 24) & 0xFF] ^
-                    Crc32Lookup[9][(two >> 16) & 0xFF] ^
-                    Crc32Lookup[10][(two >> 8) & 0xFF] ^
-                    Crc32Lookup[11][two & 0xFF] ^
-                    Crc32Lookup[12][(one >> 24) & 0xFF] ^
-                    Crc32Lookup[13][(one >> 16) & 0xFF] ^
-                    Crc32Lookup[14][(one >> 8) & 0xFF] ^
-                    Crc32Lookup[15][one & 0xFF];
-            }
-            {
-                uint32_t one = *current++ ^ crc;
-                uint32_t two = *current++;
-                uint32_t a3 = *current++;
-                uint32_t a4 = *current++;
-                crc = Crc32Lookup[0][(a4 >> 24) & 0xFF] ^
-                    Crc32Lookup[1][(a4 >> 16) & 0xFF] ^
-                    Crc32Lookup[2][(a4 >> 8) & 0xFF] ^
-                    Crc32Lookup[3][a4 & 0xFF] ^
-                    Crc32Lookup[4][(a3 >> 24) & 0xFF] ^
-                    Crc32Lookup[5][(a3 >> 16) & 0xFF] ^
-                    Crc32Lookup[6][(a3 >> 8) & 0xFF] ^
-                    Crc32Lookup[7][a3 & 0xFF] ^
-                    Crc32Lookup[8][(two >> 24) & 0xFF] ^
-                    Crc32Lookup[9][(two >> 16) & 0xFF] ^
-                    Crc32Lookup[10][(two >> 8) & 0xFF] ^
-                    Crc32Lookup[11][two & 0xFF] ^
-                    Crc32Lookup[12][(one >> 24) & 0xFF] ^
-                    Crc32Lookup[13][(one >> 16) & 0xFF] ^
-                    Crc32Lookup[14][(one >> 8) & 0xFF] ^
-                    Crc32Lookup[15][one & 0xFF];
-            }
+            // two Slicing-by-16 steps (slice16 takes care of big endian CPUs)
+            crc = slice16( crc, current );
+            current += 4;
+            crc = slice16( crc, current );
+            current += 4;
         }
 
         length -= BytesAtOnce;
     }
 
-    const uint8_t * currentChar = (const uint8_t *) current;
-    // remaining 1 to 7 bytes (standard algorithm)
+    // remaining bytes, including the last prefetchAhead bytes (no need to prefetch those)
+    return crc32_16bytes( current, length, ~crc );
+}
+
+
+
+/// compute CRC32 (Slicing-by-16 algorithm, four independent streams)
+uint32_t crc32_4way_16bytes( const void * data, size_t length, uint32_t previousCrc32 )
+{
+    // the buffer is split into four equally sized streams, each one has its own CRC register
+    // so that the table lookups of different streams don't wait on each other,
+    // finally the streams are merged by "appending zeros" (see crc32_combine)
+
+    const size_t Streams = 4;
+    const size_t BytesAtOnce = 16;
+
+    // merging costs a few hundred cycles, not worth it for short buffers
+    const size_t MinStreamLength = 1024;
+
+    if (length < Streams * MinStreamLength)
+        return crc32_16bytes( data, length, previousCrc32 );
+
+    const size_t streamLength = (length / Streams) & ~(BytesAtOnce - 1);
+    const size_t streamWords = streamLength / sizeof( uint32_t );
+
+    const uint32_t * current0 = (const uint32_t *) data;
+    const uint32_t * current1 = current0 + streamWords;
+    const uint32_t * current2 = current1 + streamWords;
+    const uint32_t * current3 = current2 + streamWords;
+
+    // only the first stream continues the previous CRC, all others start with zero
+    uint32_t crc0 = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+    uint32_t crc1 = 0;
+    uint32_t crc2 = 0;
+    uint32_t crc3 = 0;
+
+    // a shared index keeps the register pressure low
+    for (size_t i = 0; i < streamWords; i += BytesAtOnce / sizeof( uint32_t ))
+    {
+        crc0 = slice16( crc0, current0 + i );
+        crc1 = slice16( crc1, current1 + i );
+        crc2 = slice16( crc2, current2 + i );
+        crc3 = slice16( crc3, current3 + i );
+    }
+
+    // crc = ((crc0 * x^n + crc1) * x^n + crc2) * x^n + crc3, with n = 8 * streamLength
+    const uint32_t shift = zerosOperator( streamLength );
+
+    uint32_t crc = multiplyModP( shift, crc0 ) ^ crc1;
+    crc = multiplyModP( shift, crc ) ^ crc2;
+    crc = multiplyModP( shift, crc ) ^ crc3;
+
+    // remaining bytes behind the last stream
+    return crc32_16bytes( current3 + streamWords, length - Streams * streamLength, ~crc );
+}
+#endif
+
+
+#ifdef CRC32_USE_SSE42
+namespace
+{
+    /// feature flags of CPUID leaf 1 (register ECX)
+    inline uint32_t cpuidLeaf1Ecx()
+    {
+#ifdef _MSC_VER
+        int regs[4];
+        __cpuid( regs, 1 );
+        return (uint32_t) regs[2];
+#else
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) == 0)
+            return 0;
+
+        return ecx;
+#endif
+    }
+} // anonymous namespace
+#endif
+
+
+#ifdef CRC32_USE_PCLMUL
+/// compute CRC32 (carry-less multiplication folding, requires SSE4.1 and PCLMULQDQ)
+CRC32_TARGET( "sse4.1,pclmul" )
+uint32_t crc32_pclmul( const void * data, size_t length, uint32_t previousCrc32 )
+{
+    // based on Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction"
+    // (bit-reflected variant), the constants are given at the end of the paper:
+    // k1 = x^(4*128+32) mod P, k2 = x^(4*128-32) mod P  => fold 4x128 bits at once
+    // k3 = x^(128+32)   mod P, k4 = x^(128-32)   mod P  => fold 1x128 bits
+    // k5 = x^64 mod P, P' = 0x1DB710641, mu = floor(x^64 / P)  => Barrett reduction
+
+    const size_t BytesAtOnce = 64;
+
+    // too short for folding, fall back to slicing-by-16
+    if (length < BytesAtOnce)
+        return crc32_16bytes( data, length, previousCrc32 );
+
+    alignas(16) static const uint64_t k1k2[2] = { 0x0154442BD4, 0x01C6E41596 };
+    alignas(16) static const uint64_t k3k4[2] = { 0x01751997D0, 0x00CCAA009E };
+    alignas(16) static const uint64_t k5k0[2] = { 0x0163CD6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[2] = { 0x01DB710641, 0x01F7011641 };
+
+    uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+    const uint8_t * current = (const uint8_t *) data;
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    // load the first 64 bytes, the current CRC is XORed into the lowest 32 bits
+    x1 = _mm_loadu_si128( (const __m128i *) (current + 0x00) );
+    x2 = _mm_loadu_si128( (const __m128i *) (current + 0x10) );
+    x3 = _mm_loadu_si128( (const __m128i *) (current + 0x20) );
+    x4 = _mm_loadu_si128( (const __m128i *) (current + 0x30) );
+
+    x1 = _mm_xor_si128( x1, _mm_cvtsi32_si128( (int) crc ) );
+    x0 = _mm_load_si128( (const __m128i *) k1k2 );
+
+    current += BytesAtOnce;
+    length -= BytesAtOnce;
+
+    // fold four 128 bit lanes in parallel
+    while (length >= BytesAtOnce)
+    {
+        x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+        x6 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+        x7 = _mm_clmulepi64_si128( x3, x0, 0x00 );
+        x8 = _mm_clmulepi64_si128( x4, x0, 0x00 );
+
+        x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+        x2 = _mm_clmulepi64_si128( x2, x0, 0x11 );
+        x3 = _mm_clmulepi64_si128( x3, x0, 0x11 );
+        x4 = _mm_clmulepi64_si128( x4, x0, 0x11 );
+
+        y5 = _mm_loadu_si128( (const __m128i *) (current + 0x00) );
+        y6 = _mm_loadu_si128( (const __m128i *) (current + 0x10) );
+        y7 = _mm_loadu_si128( (const __m128i *) (current + 0x20) );
+        y8 = _mm_loadu_si128( (const __m128i *) (current + 0x30) );
+
+        x1 = _mm_xor_si128( _mm_xor_si128( x1, x5 ), y5 );
+        x2 = _mm_xor_si128( _mm_xor_si128( x2, x6 ), y6 );
+        x3 = _mm_xor_si128( _mm_xor_si128( x3, x7 ), y7 );
+        x4 = _mm_xor_si128( _mm_xor_si128( x4, x8 ), y8 );
+
+        current += BytesAtOnce;
+        length -= BytesAtOnce;
+    }
+
+    // fold the four lanes into a single one
+    x0 = _mm_load_si128( (const __m128i *) k3k4 );
+
+    x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+    x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+    x1 = _mm_xor_si128( _mm_xor_si128( x1, x2 ), x5 );
+
+    x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+    x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+    x1 = _mm_xor_si128( _mm_xor_si128( x1, x3 ), x5 );
+
+    x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+    x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+    x1 = _mm_xor_si128( _mm_xor_si128( x1, x4 ), x5 );
+
+    // fold remaining blocks of 16 bytes
+    while (length >= 16)
+    {
+        x2 = _mm_loadu_si128( (const __m128i *) current );
+
+        x5 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+        x1 = _mm_clmulepi64_si128( x1, x0, 0x11 );
+        x1 = _mm_xor_si128( _mm_xor_si128( x1, x2 ), x5 );
+
+        current += 16;
+        length -= 16;
+    }
+
+    // fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128( x1, x0, 0x10 );
+    x3 = _mm_setr_epi32( ~0, 0, ~0, 0 );
+    x1 = _mm_srli_si128( x1, 8 );
+    x1 = _mm_xor_si128( x1, x2 );
+
+    x0 = _mm_loadl_epi64( (const __m128i *) k5k0 );
+
+    x2 = _mm_srli_si128( x1, 4 );
+    x1 = _mm_and_si128( x1, x3 );
+    x1 = _mm_clmulepi64_si128( x1, x0, 0x00 );
+    x1 = _mm_xor_si128( x1, x2 );
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128( (const __m128i *) poly );
+
+    x2 = _mm_and_si128( x1, x3 );
+    x2 = _mm_clmulepi64_si128( x2, x0, 0x10 );
+    x2 = _mm_and_si128( x2, x3 );
+    x2 = _mm_clmulepi64_si128( x2, x0, 0x00 );
+    x1 = _mm_xor_si128( x1, x2 );
+
+    crc = (uint32_t) _mm_extract_epi32( x1, 1 );
+
+    // remaining 1 to 15 bytes (standard algorithm)
+    while (length-- > 0)
+        crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *current++];
+
+    return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+
+/// check via cpuid whether the CPU is able to run crc32_pclmul
+bool crc32_pclmul_available()
+{
+    // CPUID leaf 1, ECX: bit 1 = PCLMULQDQ, bit 19 = SSE4.1
+    const uint32_t PclmulBit = 1u << 1;
+    const uint32_t Sse41Bit = 1u << 19;
+
+    uint32_t ecx = cpuidLeaf1Ecx();
+    return (ecx & PclmulBit) != 0 && (ecx & Sse41Bit) != 0;
+}
+#endif // CRC32_USE_PCLMUL
+
+
+#ifdef CRC32_USE_VPCLMUL
+/// compute CRC32 (carry-less multiplication folding of 4x512 bits, requires AVX-512 and VPCLMULQDQ)
+CRC32_TARGET( "avx512f,avx512vl,vpclmulqdq,pclmul,sse4.1" )
+uint32_t crc32_vpclmul( const void * data, size_t length, uint32_t previousCrc32 )
+{
+    // same algorithm as crc32_pclmul, each 512 bit register holds four independent 128 bit lanes:
+    // k1 = x^(4*512+32) mod P, k2 = x^(4*512-32) mod P  => fold 4x512 bits at once
+    // k3 = x^(512+32)   mod P, k4 = x^(512-32)   mod P  => fold 1x512 bits
+    // k5 = x^(128+32)   mod P, k6 = x^(128-32)   mod P  => fold 1x128 bits
+    // the final reduction to 32 bits is identical to crc32_pclmul
+
+    const size_t BytesAtOnce = 256;
+
+    // too short for folding four 512 bit lanes
+    if (length < BytesAtOnce)
+        return crc32_pclmul( data, length, previousCrc32 );
+
+    alignas(64) static const uint64_t k1k2[8] = { 0x011542778A, 0x01322D1430, 0x011542778A, 0x01322D1430,
+                                                  0x011542778A, 0x01322D1430, 0x011542778A, 0x01322D1430 };
+    alignas(64) static const uint64_t k3k4[8] = { 0x0154442BD4, 0x01C6E41596, 0x0154442BD4, 0x01C6E41596,
+                                                  0x0154442BD4, 0x01C6E41596, 0x0154442BD4, 0x01C6E41596 };
+    alignas(16) static const uint64_t k5k6[2] = { 0x01751997D0, 0x00CCAA009E };
+    alignas(16) static const uint64_t k7k0[2] = { 0x0163CD6124, 0x0000000000 };
+    alignas(16) static const uint64_t poly[2] = { 0x01DB710641, 0x01F7011641 };
+
+    uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+    const uint8_t * current = (const uint8_t *) data;
+
+    __m512i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+    __m128i a0, a1, a2, a3;
+
+    // load the first 256 bytes, the current CRC is XORed into the lowest 32 bits
+    x1 = _mm512_loadu_si512( (const void *) (current + 0x00) );
+    x2 = _mm512_loadu_si512( (const void *) (current + 0x40) );
+    x3 = _mm512_loadu_si512( (const void *) (current + 0x80) );
+    x4 = _mm512_loadu_si512( (const void *) (current + 0xC0) );
+
+    x1 = _mm512_xor_si512( x1, _mm512_inserti32x4( _mm512_setzero_si512(), _mm_cvtsi32_si128( (int) crc ), 0 ) );
+    x0 = _mm512_load_si512( (const void *) k1k2 );
+
+    current += BytesAtOnce;
+    length -= BytesAtOnce;
+
+    // fold four 512 bit lanes in parallel
+    while (length >= BytesAtOnce)
+    {
+        x5 = _mm512_clmulepi64_epi128( x1, x0, 0x00 );
+        x6 = _mm512_clmulepi64_epi128( x2, x0, 0x00 );
+        x7 = _mm512_clmulepi64_epi128( x3, x0, 0x00 );
+        x8 = _mm512_clmulepi64_epi128( x4, x0, 0x00 );
+
+        x1 = _mm512_clmulepi64_epi128( x1, x0, 0x11 );
+        x2 = _mm512_clmulepi64_epi128( x2, x0, 0x11 );
+        x3 = _mm512_clmulepi64_epi128( x3, x0, 0x11 );
+        x4 = _mm512_clmulepi64_epi128( x4, x0, 0x11 );
+
+        y5 = _mm512_loadu_si512( (const void *) (current + 0x00) );
+        y6 = _mm512_loadu_si512( (const void *) (current + 0x40) );
+        y7 = _mm512_loadu_si512( (const void *) (current + 0x80) );
+        y8 = _mm512_loadu_si512( (const void *) (current + 0xC0) );
+
+        // three-way XOR in a single instruction (0x96 = a ^ b ^ c)
+        x1 = _mm512_ternarylogic_epi64( x1, x5, y5, 0x96 );
+        x2 = _mm512_ternarylogic_epi64( x2, x6, y6, 0x96 );
+        x3 = _mm512_ternarylogic_epi64( x3, x7, y7, 0x96 );
+        x4 = _mm512_ternarylogic_epi64( x4, x8, y8, 0x96 );
+
+        current += BytesAtOnce;
+        length -= BytesAtOnce;
+    }
+
+    // fold the four 512 bit lanes into a single one
+    x0 = _mm512_load_si512( (const void *) k3k4 );
+
+    x5 = _mm512_clmulepi64_epi128( x1, x0, 0x00 );
+    x1 = _mm512_clmulepi64_epi128( x1, x0, 0x11 );
+    x1 = _mm512_ternarylogic_epi64( x1, x2, x5, 0x96 );
+
+    x5 = _mm512_clmulepi64_epi128( x1, x0, 0x00 );
+    x1 = _mm512_clmulepi64_epi128( x1, x0, 0x11 );
+    x1 = _mm512_ternarylogic_epi64( x1, x3, x5, 0x96 );
+
+    x5 = _mm512_clmulepi64_epi128( x1, x0, 0x00 );
+    x1 = _mm512_clmulepi64_epi128( x1, x0, 0x11 );
+    x1 = _mm512_ternarylogic_epi64( x1, x4, x5, 0x96 );
+
+    // fold remaining blocks of 64 bytes
+    while (length >= 64)
+    {
+        x2 = _mm512_loadu_si512( (const void *) current );
+
+        x5 = _mm512_clmulepi64_epi128( x1, x0, 0x00 );
+        x1 = _mm512_clmulepi64_epi128( x1, x0, 0x11 );
+        x1 = _mm512_ternarylogic_epi64( x1, x2, x5, 0x96 );
+
+        current += 64;
+        length -= 64;
+    }
+
+    // fold 512 bits to 128 bits
+    a0 = _mm_load_si128( (const __m128i *) k5k6 );
+    a1 = _mm512_maskz_extracti32x4_epi32( 0xF, x1, 0 );
+
+    a2 = _mm512_maskz_extracti32x4_epi32( 0xF, x1, 1 );
+    a3 = _mm_clmulepi64_si128( a1, a0, 0x00 );
+    a1 = _mm_clmulepi64_si128( a1, a0, 0x11 );
+    a1 = _mm_xor_si128( _mm_xor_si128( a1, a3 ), a2 );
+
+    a2 = _mm512_maskz_extracti32x4_epi32( 0xF, x1, 2 );
+    a3 = _mm_clmulepi64_si128( a1, a0, 0x00 );
+    a1 = _mm_clmulepi64_si128( a1, a0, 0x11 );
+    a1 = _mm_xor_si128( _mm_xor_si128( a1, a3 ), a2 );
+
+    a2 = _mm512_maskz_extracti32x4_epi32( 0xF, x1, 3 );
+    a3 = _mm_clmulepi64_si128( a1, a0, 0x00 );
+    a1 = _mm_clmulepi64_si128( a1, a0, 0x11 );
+    a1 = _mm_xor_si128( _mm_xor_si128( a1, a3 ), a2 );
+
+    // fold remaining blocks of 16 bytes
+    while (length >= 16)
+    {
+        a2 = _mm_loadu_si128( (const __m128i *) current );
+        a3 = _mm_clmulepi64_si128( a1, a0, 0x00 );
+        a1 = _mm_clmulepi64_si128( a1, a0, 0x11 );
+        a1 = _mm_xor_si128( _mm_xor_si128( a1, a3 ), a2 );
+
+        current += 16;
+        length -= 16;
+    }
+
+    // fold 128 bits to 64 bits
+    a2 = _mm_clmulepi64_si128( a1, a0, 0x10 );
+    a3 = _mm_setr_epi32( ~0, 0, ~0, 0 );
+    a1 = _mm_srli_si128( a1, 8 );
+    a1 = _mm_xor_si128( a1, a2 );
+
+    a0 = _mm_loadl_epi64( (const __m128i *) k7k0 );
+
+    a2 = _mm_srli_si128( a1, 4 );
+    a1 = _mm_and_si128( a1, a3 );
+    a1 = _mm_clmulepi64_si128( a1, a0, 0x00 );
+    a1 = _mm_xor_si128( a1, a2 );
+
+    // Barrett reduction to 32 bits
+    a0 = _mm_load_si128( (const __m128i *) poly );
+
+    a2 = _mm_and_si128( a1, a3 );
+    a2 = _mm_clmulepi64_si128( a2, a0, 0x10 );
+    a2 = _mm_and_si128( a2, a3 );
+    a2 = _mm_clmulepi64_si128( a2, a0, 0x00 );
+    a1 = _mm_xor_si128( a1, a2 );
+
+    crc = (uint32_t) _mm_extract_epi32( a1, 1 );
+
+    // remaining 1 to 15 bytes (standard algorithm)
     while (length-- > 0)
-        crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *currentChar++];
+        crc = (crc >> 8) ^ Crc32Lookup[0][(crc & 0xFF) ^ *current++];
 
     return ~crc; // same as crc ^ 0xFFFFFFFF
 }
+
+
+/// check via cpuid / XCR0 whether the CPU and the OS are able to run crc32_vpclmul
+bool crc32_vpclmul_available()
+{
+    // CPUID leaf 1, ECX: bit 27 = OSXSAVE (XGETBV is usable)
+    // CPUID leaf 7, EBX: bit 16 = AVX512F, bit 31 = AVX512VL, ECX: bit 10 = VPCLMULQDQ
+    // XCR0: bits 1, 2 = SSE / AVX state, bits 5, 6, 7 = opmask / ZMM state enabled by the OS
+    const uint32_t OsxsaveBit = 1u << 27;
+    const uint32_t Avx512fBit = 1u << 16;
+    const uint32_t Avx512vlBit = 1u << 31;
+    const uint32_t VpclmulBit = 1u << 10;
+    const uint64_t ZmmStateMask = 0xE6;
+
+    if (!crc32_pclmul_available())
+        return false;
+
+#ifdef _MSC_VER
+    int regs[4];
+    __cpuid( regs, 1 );
+    if (((uint32_t) regs[2] & OsxsaveBit) == 0)
+        return false;
+
+    __cpuidex( regs, 7, 0 );
+    uint32_t ebx = (uint32_t) regs[1];
+    uint32_t ecx = (uint32_t) regs[2];
+
+    uint64_t xcr0 = _xgetbv( 0 );
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) == 0 || (ecx & OsxsaveBit) == 0)
+        return false;
+
+    if (__get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) == 0)
+        return false;
+
+    uint32_t xcr0Low, xcr0High;
+    __asm__ __volatile__ ( "xgetbv" : "=a" (xcr0Low), "=d" (xcr0High) : "c" (0) );
+    uint64_t xcr0 = ((uint64_t) xcr0High << 32) | xcr0Low;
+#endif
+
+    return (ebx & Avx512fBit) != 0 && (ebx & Avx512vlBit) != 0 && (ecx & VpclmulBit) != 0 &&
+           (xcr0 & ZmmStateMask) == ZmmStateMask;
+}
+#endif // CRC32_USE_VPCLMUL
+
+
+// //////////////////////////////////////////////////////////
+// runtime kernel dispatcher
+
+
+namespace
+{
+  /// look-ahead of the prefetching kernels in the table, see crc32_set_prefetch_ahead
+  std::atomic<size_t> prefetchAheadBytes( 256 );
+
+  /// prefetching kernels with the configured look-ahead, so that they match Crc32Function
+  uint32_t crc32_16bytes_prefetch_default( const void * data, size_t length, uint32_t previousCrc32 )
+  {
+    return crc32_16bytes_prefetch( data, length, previousCrc32, prefetchAheadBytes.load( std::memory_order_relaxed ) );
+  }
+
+  uint32_t crc32_2x16bytes_prefetch_default( const void * data, size_t length, uint32_t previousCrc32 )
+  {
+    return crc32_2x16bytes_prefetch( data, length, previousCrc32, prefetchAheadBytes.load( std::memory_order_relaxed ) );
+  }
+
+  /// crc32_fast aligns larger buffers of kernels with a minLength to this boundary
+  const size_t HeadAlignment = 16;
+
+  /// all kernels compiled into this binary, ordered from slowest to fastest
+  struct KernelTable
+  {
+    Crc32Kernel kernels[16];
+    size_t      count;
+
+    KernelTable() : kernels(), count(0)
+    {
+      add( "bitwise",          crc32_bitwise,          true );
+      add( "halfbyte",         crc32_halfbyte,         true );
+      add( "1byte_tableless",  crc32_1byte_tableless,  true );
+      add( "1byte_tableless2", crc32_1byte_tableless2, true );
+#ifdef CRC32_USE_LOOKUP_TABLE_BYTE
+      add( "1byte",            crc32_1byte,            true );
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_4
+      add( "4bytes",           crc32_4bytes,           true );
 #endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_8
+      add( "8bytes",           crc32_8bytes,           true );
+      add( "4x8bytes",         crc32_4x8bytes,         true );
+#endif
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+      // minLength: below one unrolled block plus the look-ahead the main loops aren't entered at all
+      add( "16bytes",            crc32_16bytes,                    true );
+      add( "2x16bytes",          crc32_2x16bytes,                  true );
+      add( "16bytes_prefetch",   crc32_16bytes_prefetch_default,   true, 64 + 256 );
+      add( "4way_16bytes",       crc32_4way_16bytes,               true, 4 * 1024 );
+      add( "2x16bytes_prefetch", crc32_2x16bytes_prefetch_default, true, 128 + 256 );
+#endif
+#ifdef CRC32_USE_PCLMUL
+      add( "pclmul",           crc32_pclmul,           crc32_pclmul_available(),  64 );
+#endif
+#ifdef CRC32_USE_VPCLMUL
+      // 64 to 255 bytes are handled by crc32_pclmul
+      add( "vpclmul",          crc32_vpclmul,          crc32_vpclmul_available(), 64 );
+#endif
+    }
+
+    void add( const char * name, Crc32Function function, bool available, size_t minLength = 0 )
+    {
+      kernels[count].name      = name;
+      kernels[count].function  = function;
+      kernels[count].available = available;
+      kernels[count].minLength = minLength;
+      count++;
+    }
 
+    /// the last available entry is the fastest one
+    const Crc32Kernel & fastest() const
+    {
+      size_t best = 0;
+      for (size_t i = 0; i < count; i++)
+        if (kernels[i].available)
+          best = i;
 
-/// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
+      return kernels[best];
+    }
+  };
+
+  /// cpuid is probed only once, on first use (thread-safe since C++11)
+  const KernelTable & kernelTable()
+  {
+    static const KernelTable table;
+    return table;
+  }
+
+  /// kernel bound to crc32_fast, nullptr until the first call or crc32_select_kernel
+  std::atomic<const Crc32Kernel *> selectedKernel( nullptr );
+
+  /// true once crc32_select_kernel pinned a kernel, crc32_multi calls only that one then
+  std::atomic<bool> kernelPinned( false );
+
+  const Crc32Kernel & boundKernel()
+  {
+    const Crc32Kernel * kernel = selectedKernel.load( std::memory_order_acquire );
+    if (kernel == nullptr)
+    {
+      kernel = &kernelTable().fastest();
+
+      // keep a kernel chosen concurrently by crc32_select_kernel
+      const Crc32Kernel * expected = nullptr;
+      if (!selectedKernel.compare_exchange_strong( expected, kernel, std::memory_order_acq_rel ))
+        kernel = expected;
+    }
+
+    return *kernel;
+  }
+} // anonymous namespace
+
+
+/// compute CRC32 using the fastest algorithm supported by the current CPU
 uint32_t crc32_fast(const void* data, size_t length, uint32_t previousCrc32)
 {
+  const Crc32Kernel& kernel = boundKernel();
+
 #ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
-  return crc32_16bytes (data, length, previousCrc32);
-#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_8)
-  return crc32_8bytes  (data, length, previousCrc32);
-#elif defined(CRC32_USE_LOOKUP_TABLE_SLICING_BY_4)
-  return crc32_4bytes  (data, length, previousCrc32);
-#elif defined(CRC32_USE_LOOKUP_TABLE_BYTE)
-  return crc32_1byte   (data, length, previousCrc32);
-#else
-  return crc32_halfbyte(data, length, previousCrc32);
+  // size classes: the kernel wouldn't enter its main loop for short buffers anyway
+  if (length < kernel.minLength)
+    return crc32_16bytes(data, length, previousCrc32);
+
+  // unaligned head, so that the kernel's loads never straddle a 16 byte boundary
+  if (kernel.minLength > 0)
+  {
+    size_t head = (HeadAlignment - ((uintptr_t) data % HeadAlignment)) % HeadAlignment;
+    if (head > 0)
+    {
+      previousCrc32 = crc32_16bytes(data, head, previousCrc32);
+      data    = (const uint8_t*) data + head;
+      length -= head;
+    }
+  }
 #endif
+
+  return kernel.function(data, length, previousCrc32);
+}
+
+
+/// list all kernels compiled into this binary, ordered from slowest to fastest
+const Crc32Kernel* crc32_kernels(size_t& count)
+{
+  const KernelTable& table = kernelTable();
+  count = table.count;
+  return table.kernels;
+}
+
+
+/// bind crc32_fast to the kernel with the given name, false if it is unknown or not supported by the CPU
+bool crc32_select_kernel(const char* name, bool pin)
+{
+  const KernelTable& table = kernelTable();
+  for (size_t i = 0; i < table.count; i++)
+  {
+    if (strcmp(table.kernels[i].name, name) != 0)
+      continue;
+
+    if (!table.kernels[i].available)
+      return false;
+
+    selectedKernel.store(&table.kernels[i], std::memory_order_release);
+    kernelPinned.store(pin, std::memory_order_release);
+    return true;
+  }
+
+  return false;
+}
+
+
+/// name of the kernel crc32_fast is bound to
+const char* crc32_selected_kernel()
+{
+  return boundKernel().name;
+}
+
+
+/// was the kernel pinned (crc32_select_kernel with pin = true)?
+bool crc32_kernel_pinned()
+{
+  return kernelPinned.load(std::memory_order_acquire);
+}
+
+
+/// set the look-ahead of the prefetching kernels when called through crc32_fast or crc32_kernels (default 256 bytes)
+void crc32_set_prefetch_ahead(size_t prefetchAhead)
+{
+  prefetchAheadBytes.store(prefetchAhead, std::memory_order_relaxed);
+}
+
+
+/// look-ahead of the prefetching kernels when called through crc32_fast or crc32_kernels
+size_t crc32_prefetch_ahead()
+{
+  return prefetchAheadBytes.load(std::memory_order_relaxed);
+}
+
+
+/// compute the CRC32 of many independent buffers, crcs[i] holds the previous CRC of data[i] and receives the result
+void crc32_multi( const void * const * data, const size_t * lengths, uint32_t * crcs, size_t count )
+{
+    const Crc32Kernel & kernel = boundKernel();
+
+    // the folding kernels aren't latency-bound, nothing to gain from interleaving
+    bool folding = false;
+#ifdef CRC32_USE_PCLMUL
+    folding |= (kernel.function == crc32_pclmul);
+#endif
+#ifdef CRC32_USE_VPCLMUL
+    folding |= (kernel.function == crc32_vpclmul);
+#endif
+
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+    // a pinned kernel (--kernel) is the only code path used, even where interleaving would be faster
+    if (!folding && !kernelPinned.load( std::memory_order_acquire ))
+    {
+        // a single Slicing-by-16 chain waits on its own table lookups, therefore four buffers
+        // are processed in lockstep (each lane with its own CRC register),
+        // a lane that runs out of data is finished and refilled with the next buffer
+        const size_t Lanes = 4;
+        const size_t BytesAtOnce = 16;
+
+        const uint32_t * current[Lanes];
+        size_t remaining[Lanes];
+        size_t buffer[Lanes];
+        uint32_t crc[Lanes];
+
+        size_t next = 0;
+        size_t active = 0;
+
+        // load the next buffer into a lane, false if all buffers are taken
+        auto refill = [&]( size_t lane ) -> bool
+        {
+            if (next == count)
+                return false;
+
+            current[lane] = (const uint32_t *) data[next];
+            remaining[lane] = lengths[next];
+            buffer[lane] = next;
+            crc[lane] = ~crcs[next]; // same as previousCrc32 ^ 0xFFFFFFFF
+            next++;
+
+            return true;
+        };
+
+        for (; active < Lanes && refill( active ); active++)
+            ;
+
+        while (active == Lanes)
+        {
+            // finish lanes with less than 16 bytes left
+            for (size_t lane = 0; lane < Lanes && active == Lanes; lane++)
+            {
+                while (remaining[lane] < BytesAtOnce)
+                {
+                    const uint8_t * currentChar = (const uint8_t *) current[lane];
+                    while (remaining[lane]-- != 0)
+                        crc[lane] = (crc[lane] >> 8) ^ Crc32Lookup[0][(crc[lane] & 0xFF) ^ *currentChar++];
+
+                    crcs[buffer[lane]] = ~crc[lane];
+
+                    if (!refill( lane ))
+                    {
+                        // move the lane to the end, the remaining lanes are finished one by one
+                        active--;
+                        current[lane] = current[active];
+                        remaining[lane] = remaining[active];
+                        buffer[lane] = buffer[active];
+                        crc[lane] = crc[active];
+                        break;
+                    }
+                }
+            }
+
+            if (active < Lanes)
+                break;
+
+            size_t steps = remaining[0];
+            for (size_t lane = 1; lane < Lanes; lane++)
+                if (remaining[lane] < steps)
+                    steps = remaining[lane];
+            steps /= BytesAtOnce;
+
+            for (size_t step = 0; step < steps; step++)
+            {
+                crc[0] = slice16( crc[0], current[0] );
+                crc[1] = slice16( crc[1], current[1] );
+                crc[2] = slice16( crc[2], current[2] );
+                crc[3] = slice16( crc[3], current[3] );
+
+                current[0] += 4;
+                current[1] += 4;
+                current[2] += 4;
+                current[3] += 4;
+            }
+
+            for (size_t lane = 0; lane < Lanes; lane++)
+                remaining[lane] -= steps * BytesAtOnce;
+        }
+
+        // less than four buffers left
+        for (size_t lane = 0; lane < active; lane++)
+            crcs[buffer[lane]] = crc32_16bytes( current[lane], remaining[lane], ~crc[lane] );
+
+        return;
+    }
+#endif
+
+    for (size_t i = 0; i < count; i++)
+        crcs[i] = kernel.function( data[i], lengths[i], crcs[i] );
 }
 
 
 /// merge two CRC32 such that result = crc32(dataB, lengthB, crc32(dataA, lengthA))
 uint32_t crc32_combine(uint32_t crcA, uint32_t crcB, size_t lengthB)
 {
-  // based on Mark Adler's crc_combine from
-  // https://github.com/madler/pigz/blob/master/pigz.c
+  // based on Mark Adler's crc32_combine from zlib 1.2.12
 
   // main idea:
   // - if you have two equally-sized blocks A and B,
@@ -713,85 +1406,170 @@ uint32_t crc32_combine(uint32_t crcA, uint32_t crcB, size_t lengthB)
   // - since B' starts with many zeros, the crc of those initial zeros is still zero
   // - that means crc(B') = crc(B)
   // - unfortunately the trailing zeros of A' change the crc, so usually crc(A') != crc(A)
-  // - the following code is a fast algorithm to compute crc(A')
-  // - starting with crc(A) and appending length(B) zeros, needing just log2(length(B)) iterations
-  // - the details are explained by the original author at
-  //   https://stackoverflow.com/questions/23122312/crc-calculation-of-a-mostly-static-data-stream/23126768
-  //
-  // notes:
-  // - I squeezed everything into one function to keep global namespace clean (original code two helper functions)
-  // - most original comments are still in place, I added comments where these helper functions where made inline code
-  // - performance-wise there isn't any differenze to the original zlib/pigz code
+  // - appending n zeros is the same as multiplying crc(A) by x^(8n) modulo the polynomial,
+  //   see crc32_shift: x^(8n) is assembled from the precomputed x^(2^k) in log2(n) multiplications
+
+  return crc32_shift(crcA, lengthB) ^ crcB;
+}
+
 
+/// append numBytes zeros to a CRC32 in the sense of crc32_combine: crc32_combine(crcA, crcB, lengthB) = crc32_shift(crcA, lengthB) ^ crcB
+uint32_t crc32_shift(uint32_t crc, size_t numBytes)
+{
   // degenerated case
-  if (lengthB == 0)
-    return crcA;
+  if (numBytes == 0)
+    return crc;
 
-  /// CRC32 => 32 bits
-  const uint32_t CrcBits = 32;
+  return multiplyModP(zerosOperator(numBytes), crc);
+}
 
-  uint32_t odd [CrcBits]; // odd-power-of-two  zeros operator
-  uint32_t even[CrcBits]; // even-power-of-two zeros operator
 
-  // put operator for one zero bit in odd
-  odd[0] = Polynomial;    // CRC-32 polynomial
-  for (int i = 1; i < CrcBits; i++)
-    odd[i] = 1 << (i - 1);
+/// merge multiple CRC32 such that result = crc32 of all blocks concatenated (lengths[0] isn't needed)
+uint32_t crc32_combine_n(const uint32_t* crcs, const size_t* lengths, size_t count)
+{
+  if (count == 0)
+    return 0;
 
-  // put operator for two zero bits in even
-  // same as gf2_matrix_square(even, odd);
-  for (int i = 0; i < CrcBits; i++)
-  {
-    uint32_t vec = odd[i];
-    even[i] = 0;
-    for (int j = 0; vec != 0; j++, vec >>= 1)
-      if (vec & 1)
-        even[i] ^= odd[j];
-  }
-  // put operator for four zero bits in odd
-  // same as gf2_matrix_square(odd, even);
-  for (int i = 0; i < CrcBits; i++)
-  {
-    uint32_t vec = even[i];
-    odd[i] = 0;
-    for (int j = 0; vec != 0; j++, vec >>= 1)
-      if (vec & 1)
-        odd[i] ^= even[j];
-  }
+  uint32_t crc = crcs[0];
+  for (size_t i = 1; i < count; i++)
+    crc = crc32_shift(crc, lengths[i]) ^ crcs[i];
 
-  // the following loop becomes much shorter if I keep swapping even and odd
-  uint32_t* a = even;
-  uint32_t* b = odd;
-  // apply secondLength zeros to firstCrc32
-  for (; lengthB > 0; lengthB >>= 1)
-  {
-    // same as gf2_matrix_square(a, b);
-    for (int i = 0; i < CrcBits; i++)
+  return crc;
+}
+
+
+// //////////////////////////////////////////////////////////
+// CRC32C (Castagnoli)
+
+
+/// compute CRC32C (Slicing-by-16 algorithm, tables generated by CrcEngine)
+uint32_t crc32c_16bytes(const void* data, size_t length, uint32_t previousCrc32)
+{
+  return Crc32C::calculate(data, length, previousCrc32);
+}
+
+
+#ifdef CRC32_USE_SSE42
+namespace
+{
+    /// feed 8 bytes into the crc32 instruction
+    CRC32_TARGET( "sse4.2" )
+    inline uint32_t crc32cWord( uint32_t crc, const uint8_t * current )
     {
-      uint32_t vec = b[i];
-      a[i] = 0;
-      for (int j = 0; vec != 0; j++, vec >>= 1)
-        if (vec & 1)
-          a[i] ^= b[j];
+#if defined(_M_X64) || defined(__x86_64__)
+        uint64_t word;
+        memcpy( &word, current, sizeof( word ) );
+        return (uint32_t) _mm_crc32_u64( crc, word );
+#else
+        uint32_t one, two;
+        memcpy( &one, current, sizeof( one ) );
+        memcpy( &two, current + 4, sizeof( two ) );
+        return _mm_crc32_u32( _mm_crc32_u32( crc, one ), two );
+#endif
     }
 
-    // apply zeros operator for this bit
-    if (lengthB & 1)
+    /// process as many blocks of 3 * BlockSize bytes as possible, three independent streams per block
+    template <size_t BlockSize>
+    CRC32_TARGET( "sse4.2" )
+    inline uint32_t crc32cThreeStreams( uint32_t crc, const uint8_t *& current, size_t & length )
     {
-      // same as firstCrc32 = gf2_matrix_times(a, firstCrc32);
-      uint32_t sum = 0;
-      for (int i = 0; crcA != 0; i++, crcA >>= 1)
-        if (crcA & 1)
-          sum ^= a[i];
-      crcA = sum;
+        // crc(A concat B concat C) = (crc(A) * x^(16n) + crc(B) * x^(8n) + crc(C)) mod P, with n = BlockSize
+        static constexpr uint32_t ShiftOne = Crc32C::shift_operator( BlockSize );
+        static constexpr uint32_t ShiftTwo = Crc32C::shift_operator( 2 * BlockSize );
+
+        while (length >= 3 * BlockSize)
+        {
+            uint32_t crcA = crc;
+            uint32_t crcB = 0;
+            uint32_t crcC = 0;
+
+            for (size_t i = 0; i < BlockSize; i += 8)
+            {
+                crcA = crc32cWord( crcA, current + i );
+                crcB = crc32cWord( crcB, current + i + BlockSize );
+                crcC = crc32cWord( crcC, current + i + 2 * BlockSize );
+            }
+
+            crc = Crc32C::shift_by( crcA, ShiftTwo ) ^ Crc32C::shift_by( crcB, ShiftOne ) ^ crcC;
+
+            current += 3 * BlockSize;
+            length -= 3 * BlockSize;
+        }
+
+        return crc;
     }
+} // anonymous namespace
 
-    // switch even and odd
-    uint32_t* t = a; a = b; b = t;
-  }
 
-  // return combined crc
-  return crcA ^ crcB;
+/// compute CRC32C (SSE4.2 crc32 instruction, three interleaved streams)
+CRC32_TARGET( "sse4.2" )
+uint32_t crc32c_sse42( const void * data, size_t length, uint32_t previousCrc32 )
+{
+    // the crc32 instruction has a latency of three cycles but can start a new one each cycle,
+    // hence three streams are hashed in parallel and merged by "appending zeros" (see crc32_combine)
+
+    uint32_t crc = ~previousCrc32; // same as previousCrc32 ^ 0xFFFFFFFF
+    const uint8_t * current = (const uint8_t *) data;
+
+    // process single bytes until the data is 8-byte aligned
+    while (length != 0 && ((uintptr_t) current & 7) != 0)
+    {
+        crc = _mm_crc32_u8( crc, *current++ );
+        length--;
+    }
+
+    // long blocks first, merging costs about the same as hashing 100 bytes
+    crc = crc32cThreeStreams<8192>( crc, current, length );
+    crc = crc32cThreeStreams<256>( crc, current, length );
+
+    // remaining 0 to 767 bytes, single stream
+    while (length >= 8)
+    {
+        crc = crc32cWord( crc, current );
+        current += 8;
+        length -= 8;
+    }
+
+    while (length-- != 0)
+        crc = _mm_crc32_u8( crc, *current++ );
+
+    return ~crc; // same as crc ^ 0xFFFFFFFF
+}
+
+
+/// check via cpuid whether the CPU is able to run crc32c_sse42
+bool crc32c_sse42_available()
+{
+    // CPUID leaf 1, ECX: bit 20 = SSE4.2
+    const uint32_t Sse42Bit = 1u << 20;
+
+    return (cpuidLeaf1Ecx() & Sse42Bit) != 0;
+}
+#endif // CRC32_USE_SSE42
+
+
+/// compute CRC32C using the SSE4.2 crc32 instruction if supported by the CPU, otherwise Slicing-by-16
+uint32_t crc32c_fast(const void* data, size_t length, uint32_t previousCrc32)
+{
+#ifdef CRC32_USE_SSE42
+  static const bool hasSse42 = crc32c_sse42_available();
+  if (hasSse42)
+    return crc32c_sse42(data, length, previousCrc32);
+#endif
+
+  return crc32c_16bytes(data, length, previousCrc32);
+}
+
+
+/// name of the kernel crc32c_fast uses
+const char* crc32c_selected_kernel()
+{
+#ifdef CRC32_USE_SSE42
+  if (crc32c_sse42_available())
+    return "sse42";
+#endif
+
+  return "16bytes";
 }
 
 
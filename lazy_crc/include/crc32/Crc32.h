@@ -6,6 +6,8 @@
 // see http://create.stephan-brumme.com/disclaimer.html
 //
 
+#pragma once
+
 // if running on an embedded system, you might consider shrinking the
 // big Crc32Lookup table by undefining these lines:
 #define CRC32_USE_LOOKUP_TABLE_BYTE
@@ -22,17 +24,63 @@
 // - crc32_16bytes  needs all of Crc32Lookup
 // using the aforementioned #defines the table is automatically fitted to your needs
 
+// hardware CRC32C (SSE4.2) and carry-less multiplication folding (SSE4.1 + PCLMULQDQ) are only available on x86 / x64,
+// both are selected at runtime and fall back to the slicing-by-16 algorithm
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CRC32_USE_SSE42
+#ifdef CRC32_USE_LOOKUP_TABLE_SLICING_BY_16
+#define CRC32_USE_PCLMUL
+// AVX-512 VPCLMULQDQ folding requires Visual Studio 2019, GCC 8 or Clang 6 (or newer), undefine for older compilers
+#define CRC32_USE_VPCLMUL
+#endif
+#endif
+
 // uint8_t, uint32_t, int32_t
 #include <stdint.h>
 // size_t
 #include <cstddef>
 
-// crc32_fast selects the fastest algorithm depending on flags (CRC32_USE_LOOKUP_...)
-/// compute CRC32 using the fastest algorithm for large datasets on modern CPUs
+// crc32_fast probes the CPU once and calls the fastest available kernel (see crc32_select_kernel)
+/// compute CRC32 using the fastest algorithm supported by the current CPU
 uint32_t crc32_fast    (const void* data, size_t length, uint32_t previousCrc32 = 0);
 
+/// common signature of all CRC32 kernels (prefetching kernels use crc32_prefetch_ahead)
+typedef uint32_t (*Crc32Function)(const void* data, size_t length, uint32_t previousCrc32);
+
+/// CRC32 kernel known to the runtime dispatcher
+struct Crc32Kernel
+{
+  const char*   name;      ///< e.g. "16bytes" for crc32_16bytes
+  Crc32Function function;
+  bool          available; ///< false if the CPU lacks the required instructions
+  size_t        minLength; ///< crc32_fast hands shorter buffers and unaligned heads to crc32_16bytes (0 = never)
+};
+
+/// list all kernels compiled into this binary, ordered from slowest to fastest
+const Crc32Kernel* crc32_kernels(size_t& count);
+/// bind crc32_fast to the kernel with the given name, false if it is unknown or not supported by the CPU;
+/// pin = false only replaces the probed choice (e.g. a tuned profile), crc32_multi may still interleave buffers
+bool crc32_select_kernel(const char* name, bool pin = true);
+/// name of the kernel crc32_fast is bound to
+const char* crc32_selected_kernel();
+/// was the kernel pinned (crc32_select_kernel with pin = true)?
+bool crc32_kernel_pinned();
+/// set the look-ahead of the prefetching kernels when called through crc32_fast or crc32_kernels (default 256 bytes)
+void crc32_set_prefetch_ahead(size_t prefetchAhead);
+/// look-ahead of the prefetching kernels when called through crc32_fast or crc32_kernels
+size_t crc32_prefetch_ahead();
+
+/// compute the CRC32 of many independent buffers, crcs[i] holds the previous CRC of data[i] and receives the result
+/// (table kernels interleave up to four buffers, much faster than separate calls for short buffers;
+/// a kernel pinned with crc32_select_kernel is called for every buffer instead)
+void crc32_multi( const void * const * data, const size_t * lengths, uint32_t * crcs, size_t count );
+
 /// merge two CRC32 such that result = crc32(dataB, lengthB, crc32(dataA, lengthA))
 uint32_t crc32_combine (uint32_t crcA, uint32_t crcB, size_t lengthB);
+/// append numBytes zeros to a CRC32 in the sense of crc32_combine: crc32_combine(crcA, crcB, lengthB) = crc32_shift(crcA, lengthB) ^ crcB
+uint32_t crc32_shift   (uint32_t crc, size_t numBytes);
+/// merge multiple CRC32 such that result = crc32 of all blocks concatenated (lengths[0] isn't needed)
+uint32_t crc32_combine_n(const uint32_t* crcs, const size_t* lengths, size_t count);
 
 /// compute CRC32 (bitwise algorithm)
 uint32_t crc32_bitwise (const void* data, size_t length, uint32_t previousCrc32 = 0);
@@ -68,4 +116,40 @@ uint32_t crc32_2x16bytes( const void * data, size_t length, uint32_t previousCrc
 /// compute CRC32 (Slicing-by-16 algorithm, prefetch upcoming data blocks)
 uint32_t crc32_16bytes_prefetch(const void* data, size_t length, uint32_t previousCrc32 = 0, size_t prefetchAhead = 256);
 uint32_t crc32_2x16bytes_prefetch( const void * data, size_t length, uint32_t previousCrc32 = 0, size_t prefetchAhead = 256 );
+/// compute CRC32 (Slicing-by-16 algorithm, four independent streams merged at the end)
+uint32_t crc32_4way_16bytes( const void * data, size_t length, uint32_t previousCrc32 = 0 );
+/// Slicing-by-16 as run on big endian CPUs, on words holding the data most significant byte first and on whole
+/// 16 byte slices (length is rounded down), so the self-test runs that code on little endian CPUs too
+uint32_t crc32_16bytes_big_endian( const uint32_t * words, size_t length, uint32_t previousCrc32 = 0 );
+#endif
+
+#ifdef CRC32_USE_PCLMUL
+/// compute CRC32 (carry-less multiplication folding, requires SSE4.1 and PCLMULQDQ)
+uint32_t crc32_pclmul( const void * data, size_t length, uint32_t previousCrc32 = 0 );
+/// check via cpuid whether the CPU is able to run crc32_pclmul
+bool crc32_pclmul_available();
+#endif
+
+#ifdef CRC32_USE_VPCLMUL
+/// compute CRC32 (carry-less multiplication folding of 4x512 bits, requires AVX-512 and VPCLMULQDQ)
+uint32_t crc32_vpclmul( const void * data, size_t length, uint32_t previousCrc32 = 0 );
+/// check via cpuid / XCR0 whether the CPU and the OS are able to run crc32_vpclmul
+bool crc32_vpclmul_available();
+#endif
+
+
+// CRC32C (Castagnoli polynomial 0x82F63B78), same parameter semantics as the CRC32 functions
+
+/// compute CRC32C using the SSE4.2 crc32 instruction if supported by the CPU, otherwise Slicing-by-16
+uint32_t crc32c_fast   (const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// compute CRC32C (Slicing-by-16 algorithm, tables generated by CrcEngine)
+uint32_t crc32c_16bytes(const void* data, size_t length, uint32_t previousCrc32 = 0);
+/// name of the kernel crc32c_fast uses
+const char* crc32c_selected_kernel();
+
+#ifdef CRC32_USE_SSE42
+/// compute CRC32C (SSE4.2 crc32 instruction, three interleaved streams)
+uint32_t crc32c_sse42( const void * data, size_t length, uint32_t previousCrc32 = 0 );
+/// check via cpuid whether the CPU is able to run crc32c_sse42
+bool crc32c_sse42_available();
 #endif
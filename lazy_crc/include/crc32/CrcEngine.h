@@ -0,0 +1,367 @@
+// //////////////////////////////////////////////////////////
+// CrcEngine.h
+// Table-driven CRC for arbitrary polynomials (8 to 64 bits),
+// the Slicing-by-16 tables are generated at compile time
+//
+// The parameters follow the usual CRC catalogue notation (width, poly, refin = refout, init, xorout):
+//   using Crc32C = CrcEngine<32, 0x1EDC6F41, true, 0xFFFFFFFF, 0xFFFFFFFF>;
+//   uint32_t crc = Crc32C::calculate( data, length );
+//   crc          = Crc32C::calculate( more, moreLength, crc ); // continue
+//
+
+#pragma once
+
+// uint8_t, uint32_t, uint64_t
+#include <stdint.h>
+// size_t
+#include <cstddef>
+// std::conditional
+#include <type_traits>
+// memcpy
+#include <cstring>
+
+// prefetching, same as in Crc32.cpp
+#if defined(_MSC_VER) && !defined(__clang__)
+  #include <xmmintrin.h>
+  #define CRC_ENGINE_PREFETCH(location) _mm_prefetch((const char *) (location), _MM_HINT_T0)
+#elif defined(__GNUC__)
+  #define CRC_ENGINE_PREFETCH(location) __builtin_prefetch(location)
+#else
+  #define CRC_ENGINE_PREFETCH(location) ;
+#endif
+
+// Windows is always little endian, GCC / Clang tell us
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  #define CRC_ENGINE_BIG_ENDIAN
+#endif
+
+
+namespace crc_engine_detail
+{
+    /// reverse the lowest width bits
+    constexpr uint64_t reflect( uint64_t value, unsigned width )
+    {
+        uint64_t result = 0;
+        for (unsigned i = 0; i < width; i++, value >>= 1)
+            result = (result << 1) | (value & 1);
+
+        return result;
+    }
+
+    /// swap endianess
+    inline uint64_t swap( uint64_t x )
+    {
+    #if defined(_MSC_VER) && !defined(__clang__)
+        return _byteswap_uint64( x );
+    #else
+        return __builtin_bswap64( x );
+    #endif
+    }
+
+    /// load 8 bytes, the first byte ends up in the lowest bits
+    inline uint64_t load64( const uint8_t * data )
+    {
+        uint64_t value;
+        memcpy( &value, data, sizeof( value ) );
+    #ifdef CRC_ENGINE_BIG_ENDIAN
+        value = swap( value );
+    #endif
+        return value;
+    }
+} // namespace crc_engine_detail
+
+
+template <unsigned Width, uint64_t Polynomial, bool Reflected, uint64_t Init, uint64_t XorOut>
+class CrcEngine
+{
+    static_assert( Width >= 8 && Width <= 64 && Width % 8 == 0, "CRC width must be 8, 16, 24, ... or 64 bits" );
+
+public:
+    /// uint32_t for CRCs up to 32 bits, uint64_t otherwise
+    using value_type = typename std::conditional<(Width <= 32), uint32_t, uint64_t>::type;
+
+    /// all bits of the CRC set
+    static constexpr value_type Mask = value_type( ~uint64_t( 0 ) >> (64 - Width) );
+
+    /// previousCrc to start a new CRC, the same as the CRC of zero bytes
+    static constexpr value_type InitialCrc = value_type( ((Reflected ? crc_engine_detail::reflect( Init, Width ) : Init) ^ XorOut) & Mask );
+
+    /// compute CRC (bitwise algorithm), reference implementation
+    static value_type bitwise( const void * data, size_t length, value_type previousCrc = InitialCrc )
+    {
+        value_type crc = toRegister( previousCrc );
+        const uint8_t * current = (const uint8_t *) data;
+
+        while (length-- != 0)
+        {
+            if (Reflected)
+            {
+                crc ^= *current++;
+                for (int j = 0; j < 8; j++)
+                    crc = (crc >> 1) ^ ((0 - (crc & 1)) & ReflectedPolynomial);
+            }
+            else
+            {
+                crc ^= value_type( *current++ ) << (Width - 8);
+                for (int j = 0; j < 8; j++)
+                    crc = ((crc << 1) ^ ((0 - ((crc >> (Width - 1)) & 1)) & NormalPolynomial)) & Mask;
+            }
+        }
+
+        return fromRegister( crc );
+    }
+
+    /// compute CRC (Slicing-by-16 algorithm)
+    static value_type calculate( const void * data, size_t length, value_type previousCrc = InitialCrc )
+    {
+        value_type crc = toRegister( previousCrc );
+        const uint8_t * current = (const uint8_t *) data;
+
+        // enabling optimization (at least -O2) automatically unrolls the inner for-loop
+        const size_t Unroll = 4;
+        const size_t BytesAtOnce = 16 * Unroll;
+
+        while (length >= BytesAtOnce)
+        {
+            for (size_t unrolling = 0; unrolling < Unroll; unrolling++)
+            {
+                crc = slice16( crc, current );
+                current += 16;
+            }
+
+            length -= BytesAtOnce;
+        }
+
+        return fromRegister( finish( crc, current, length ) );
+    }
+
+    /// compute CRC (Slicing-by-16 algorithm, prefetch upcoming data blocks)
+    static value_type calculate_prefetch( const void * data, size_t length, value_type previousCrc = InitialCrc, size_t prefetchAhead = 256 )
+    {
+        // CRC code is identical to calculate (including unrolling), only added prefetching
+        value_type crc = toRegister( previousCrc );
+        const uint8_t * current = (const uint8_t *) data;
+
+        const size_t Unroll = 4;
+        const size_t BytesAtOnce = 16 * Unroll;
+
+        while (length >= BytesAtOnce + prefetchAhead)
+        {
+            CRC_ENGINE_PREFETCH( current + prefetchAhead );
+
+            for (size_t unrolling = 0; unrolling < Unroll; unrolling++)
+            {
+                crc = slice16( crc, current );
+                current += 16;
+            }
+
+            length -= BytesAtOnce;
+        }
+
+        return fromRegister( finish( crc, current, length ) );
+    }
+
+    /// append numBytes zeros to a CRC in the sense of combine: combine(crcA, crcB, lengthB) = shift(crcA, lengthB) ^ crcB
+    static value_type shift( value_type crc, size_t numBytes )
+    {
+        if (numBytes == 0)
+            return crc;
+
+        return shift_by( crc, shift_operator( numBytes ) );
+    }
+
+    /// x^(8*numBytes) modulo the polynomial, precompute it to shift many CRCs by the same number of bytes
+    static constexpr value_type shift_operator( size_t numBytes )
+    {
+        return zerosOperator( numBytes );
+    }
+
+    /// same as shift(crc, numBytes) with shiftOperator = shift_operator(numBytes)
+    static value_type shift_by( value_type crc, value_type shiftOperator )
+    {
+        // multiplication modulo the polynomial is done in the reflected domain
+        value_type operand = Reflected ? crc : reflect( crc );
+        value_type result = multiplyModP( shiftOperator, operand );
+
+        return Reflected ? result : reflect( result );
+    }
+
+    /// merge two CRCs such that result = calculate(dataB, lengthB, calculate(dataA, lengthA))
+    static value_type combine( value_type crcA, value_type crcB, size_t lengthB )
+    {
+        // see crc32_combine, the XOR takes care of init != xorout
+        return shift( value_type( crcA ^ InitialCrc ), lengthB ) ^ crcB;
+    }
+
+private:
+    static value_type reflect( value_type value )
+    {
+        return value_type( crc_engine_detail::reflect( value, Width ) );
+    }
+
+    static constexpr value_type NormalPolynomial = value_type( Polynomial & Mask );
+    static constexpr value_type ReflectedPolynomial = value_type( crc_engine_detail::reflect( Polynomial, Width ) );
+
+    /// the CRC register is the CRC without xorout
+    static value_type toRegister( value_type crc )
+    {
+        return value_type( (crc ^ XorOut) & Mask );
+    }
+
+    static value_type fromRegister( value_type crc )
+    {
+        return value_type( (crc ^ XorOut) & Mask );
+    }
+
+    /// Slicing-by-16 look-up tables, Lookup[k][v] = CRC register after byte v followed by k zero bytes
+    struct Tables
+    {
+        value_type lookup[16][256];
+
+        constexpr Tables() : lookup()
+        {
+            for (unsigned v = 0; v < 256; v++)
+            {
+                value_type crc = 0;
+                if (Reflected)
+                {
+                    crc = value_type( v );
+                    for (int j = 0; j < 8; j++)
+                        crc = (crc >> 1) ^ ((0 - (crc & 1)) & ReflectedPolynomial);
+                }
+                else
+                {
+                    crc = value_type( value_type( v ) << (Width - 8) );
+                    for (int j = 0; j < 8; j++)
+                        crc = value_type( ((crc << 1) ^ ((0 - ((crc >> (Width - 1)) & 1)) & NormalPolynomial)) & Mask );
+                }
+                lookup[0][v] = crc;
+            }
+
+            for (unsigned slice = 1; slice < 16; slice++)
+            {
+                for (unsigned v = 0; v < 256; v++)
+                {
+                    value_type previous = lookup[slice - 1][v];
+                    if (Reflected)
+                        lookup[slice][v] = (previous >> 8) ^ lookup[0][previous & 0xFF];
+                    else
+                        lookup[slice][v] = value_type( ((previous << 8) ^ lookup[0][(previous >> (Width - 8)) & 0xFF]) & Mask );
+                }
+            }
+        }
+    };
+
+    static constexpr Tables Lookup{};
+
+    /// process 16 bytes, all Width / 8 bytes of the CRC register are XORed into the first bytes of the block
+    static value_type slice16( value_type crc, const uint8_t * current )
+    {
+        uint64_t one = crc_engine_detail::load64( current );
+        uint64_t two = crc_engine_detail::load64( current + 8 );
+
+        // reflected: lowest byte of the CRC first, otherwise highest byte first
+        if (Reflected)
+            one ^= crc;
+        else
+            one ^= crc_engine_detail::swap( uint64_t( crc ) << (64 - Width) );
+
+        const auto & lookup = Lookup.lookup;
+        return lookup[ 0][(two >> 56) & 0xFF] ^
+               lookup[ 1][(two >> 48) & 0xFF] ^
+               lookup[ 2][(two >> 40) & 0xFF] ^
+               lookup[ 3][(two >> 32) & 0xFF] ^
+               lookup[ 4][(two >> 24) & 0xFF] ^
+               lookup[ 5][(two >> 16) & 0xFF] ^
+               lookup[ 6][(two >>  8) & 0xFF] ^
+               lookup[ 7][ two        & 0xFF] ^
+               lookup[ 8][(one >> 56) & 0xFF] ^
+               lookup[ 9][(one >> 48) & 0xFF] ^
+               lookup[10][(one >> 40) & 0xFF] ^
+               lookup[11][(one >> 32) & 0xFF] ^
+               lookup[12][(one >> 24) & 0xFF] ^
+               lookup[13][(one >> 16) & 0xFF] ^
+               lookup[14][(one >>  8) & 0xFF] ^
+               lookup[15][ one        & 0xFF];
+    }
+
+    /// remaining 16-byte blocks (Slicing-by-16) and 1 to 15 bytes (standard algorithm)
+    static value_type finish( value_type crc, const uint8_t * current, size_t length )
+    {
+        while (length >= 16)
+        {
+            crc = slice16( crc, current );
+            current += 16;
+            length -= 16;
+        }
+
+        while (length-- != 0)
+        {
+            if (Reflected)
+                crc = (crc >> 8) ^ Lookup.lookup[0][(crc ^ *current++) & 0xFF];
+            else
+                crc = value_type( ((crc << 8) ^ Lookup.lookup[0][((crc >> (Width - 8)) ^ *current++) & 0xFF]) & Mask );
+        }
+
+        return crc;
+    }
+
+    /// multiply two polynomials modulo the reflected polynomial (x^0 is the highest bit)
+    static constexpr value_type multiplyModP( value_type a, value_type b )
+    {
+        value_type product = 0;
+        for (value_type mask = value_type( 1 ) << (Width - 1); mask != 0; mask >>= 1)
+        {
+            if (a & mask)
+            {
+                product ^= b;
+                // no more bits left in a
+                if ((a & (mask - 1)) == 0)
+                    break;
+            }
+            // b *= x
+            b = (b >> 1) ^ ((0 - (b & 1)) & ReflectedPolynomial);
+        }
+
+        return product;
+    }
+
+    /// x^(2^k) mod polynomial (reflected) for k = 0..66, enough for numBytes * 8 up to 2^67
+    struct PowersOfTwo
+    {
+        value_type power[67];
+
+        constexpr PowersOfTwo() : power()
+        {
+            power[0] = value_type( 1 ) << (Width - 2); // x^1
+            for (int k = 1; k < 67; k++)
+                power[k] = multiplyModP( power[k - 1], power[k - 1] );
+        }
+    };
+
+    static constexpr PowersOfTwo X2n{};
+
+    /// x^(8*numBytes) mod polynomial (reflected)
+    static constexpr value_type zerosOperator( size_t numBytes )
+    {
+        value_type result = value_type( 1 ) << (Width - 1); // x^0
+        // start at x^8 = x^(2^3) (one byte)
+        for (unsigned k = 3; numBytes != 0; numBytes >>= 1, k++)
+            if (numBytes & 1)
+                result = multiplyModP( X2n.power[k], result );
+
+        return result;
+    }
+};
+
+
+/// CRC-32 (zlib, PKZIP, SFV), same as crc32_fast
+using Crc32Zlib  = CrcEngine<32, 0x04C11DB7, true,  0xFFFFFFFF, 0xFFFFFFFF>;
+/// CRC-32C (Castagnoli, iSCSI, SSE4.2)
+using Crc32C     = CrcEngine<32, 0x1EDC6F41, true,  0xFFFFFFFF, 0xFFFFFFFF>;
+/// CRC-32/BZIP2 (not reflected)
+using Crc32Bzip2 = CrcEngine<32, 0x04C11DB7, false, 0xFFFFFFFF, 0xFFFFFFFF>;
+/// CRC-64/XZ (xz, 7-Zip)
+using Crc64Xz    = CrcEngine<64, 0x42F0E1EBA9EA3693, true,  0xFFFFFFFFFFFFFFFF, 0xFFFFFFFFFFFFFFFF>;
+/// CRC-64/ECMA-182 (not reflected)
+using Crc64Ecma  = CrcEngine<64, 0x42F0E1EBA9EA3693, false, 0x0000000000000000, 0x0000000000000000>;
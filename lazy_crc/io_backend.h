@@ -0,0 +1,1555 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <winioctl.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <csetjmp>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// io_uring through the raw system calls, liburing isn't needed
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define IO_USE_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#endif
+#endif
+
+// Returned by io_file::read_at on failure
+constexpr std::size_t IO_ERROR{ static_cast<std::size_t>(-1) };
+
+// Size of the views mapped by the mmap backend, large files are mapped one window at a time
+// so they never need more address space than this (32 bit builds)
+constexpr std::size_t IO_MAP_WINDOW{ 67108864 }; // 64 Mb
+
+// Reads kept in flight by the io_uring backend (--queue-depth) and the size of each of them,
+// the registered buffers (depth * block) count towards RLIMIT_MEMLOCK
+constexpr std::size_t IO_QUEUE_DEPTH{ 32 };
+constexpr std::size_t IO_QUEUE_DEPTH_MAX{ 4096 };
+constexpr std::size_t IO_URING_BLOCK{ 131072 }; // 128 Kb
+
+// The buffers of the rings of all threads together take at most 1 / IO_URING_MEMORY_SHARE of the physical
+// memory, the depth is cut down to IO_QUEUE_DEPTH_MIN at most to stay within RLIMIT_MEMLOCK
+constexpr std::size_t IO_URING_MEMORY_SHARE{ 8 };
+constexpr std::size_t IO_QUEUE_DEPTH_MIN{ 8 };
+
+// Reads bypassing the page cache (--io=direct) start and end on this boundary (512 byte and 4 Kb sectors),
+// the synchronous ones read blocks of IO_DIRECT_BLOCK
+constexpr std::size_t IO_DIRECT_ALIGNMENT{ 4096 };
+constexpr std::size_t IO_DIRECT_BLOCK{ 1048576 }; // 1 Mb
+
+// Backends available on this system (--io), the first one is the default
+#ifdef _WIN32
+constexpr const wchar_t * IO_BACKENDS[]{ L"win32", L"mmap", L"direct" };
+#elif defined(IO_USE_URING)
+constexpr const wchar_t * IO_BACKENDS[]{ L"pread", L"mmap", L"uring", L"direct" };
+#else
+constexpr const wchar_t * IO_BACKENDS[]{ L"pread", L"mmap", L"direct" };
+#endif
+
+// Backend settings given on the command line
+struct io_options
+{
+    std::size_t queue_depth{ IO_QUEUE_DEPTH };
+    std::size_t threads{ 0x1 }; // threads which may read at once, each with a ring of its own
+};
+
+// Access pattern hints (io_file::advise)
+enum class io_advice
+{
+    sequential, // read from start to end, more read-ahead
+    willneed,   // range is read soon
+    dontneed    // range won't be read again, drop it from the page cache
+};
+
+
+// File opened by an I/O backend, closed on destruction
+class io_file
+{
+public:
+    virtual ~io_file() = default;
+
+    // File size in bytes, false on failure
+    virtual bool size( std::uint64_t & file_size ) = 0;
+
+    // Read up to length bytes at offset, returns the number of bytes read (less only at the end of the file) or IO_ERROR
+    virtual std::size_t read_at( void * buffer, std::size_t length, std::uint64_t offset ) = 0;
+
+    // Hint the access pattern of a range (length 0 = up to the end of the file), false if not supported
+    virtual bool advise( io_advice advice, std::uint64_t offset = 0x0, std::uint64_t length = 0x0 ) = 0;
+
+    // Does the backend read the file itself and pass it to read_view (mapping, asynchronous reads)?
+    virtual bool has_views() const { return false; }
+
+    // Pass the range to consume( data, length ) in order, one window at a time, false on failure
+    // (including a file truncated while it is read). consume must not own anything that needs
+    // a destructor, the mmap backend may jump out of it on an I/O error
+    virtual bool read_view( std::uint64_t offset, std::uint64_t length, const std::function<void( const void *, std::size_t )> & consume )
+    {
+        static_cast<void>(offset);
+        static_cast<void>(length);
+        static_cast<void>(consume);
+
+        return false;
+    }
+
+    virtual void close() = 0;
+};
+
+
+// One read of a batch (io_backend::read_batch)
+struct io_request
+{
+    io_file * file;
+    void * buffer;
+    std::size_t length;
+    std::uint64_t offset;
+    std::size_t result; // bytes read (less only at the end of the file) or IO_ERROR
+};
+
+
+// File access method (--io=<name>)
+class io_backend
+{
+public:
+    virtual ~io_backend() = default;
+
+    // Name as used by --io
+    virtual const wchar_t * name() const = 0;
+
+    // Open the file for reading, nullptr on failure
+    virtual std::unique_ptr<io_file> open( const std::filesystem::path & path ) = 0;
+
+    // Read all the requests (files opened by this backend), one after another unless the backend can overlap them
+    virtual void read_batch( io_request * requests, std::size_t count )
+    {
+        for (std::size_t i = 0x0; i < count; i++)
+            requests[i].result = requests[i].file->read_at( requests[i].buffer, requests[i].length, requests[i].offset );
+    }
+};
+
+
+// Memory aligned for reads bypassing the page cache
+struct io_aligned_free
+{
+    void operator()( std::uint8_t * data ) const
+    {
+#ifdef _WIN32
+        _aligned_free( data );
+#else
+        std::free( data );
+#endif
+    }
+};
+
+using io_aligned_ptr = std::unique_ptr<std::uint8_t[], io_aligned_free>;
+
+inline io_aligned_ptr io_aligned_alloc( std::size_t size, std::size_t alignment )
+{
+#ifdef _WIN32
+    return io_aligned_ptr( static_cast<std::uint8_t *>(_aligned_malloc( size, alignment )) );
+#else
+    void * data{ nullptr };
+    return io_aligned_ptr( (posix_memalign( &data, alignment, size ) == 0) ? static_cast<std::uint8_t *>(data) : nullptr );
+#endif
+}
+
+
+// Pool buffers are page aligned (enough for O_DIRECT), huge page candidates are aligned to a huge page
+constexpr std::size_t IO_PAGE_SIZE{ 4096 };
+constexpr std::size_t IO_HUGE_PAGE_SIZE{ 2097152 }; // 2 Mb
+
+// Memory the pool keeps for later leases (--pool-cap), buffers returned beyond it are freed
+constexpr std::size_t IO_POOL_CAP{ 268435456 }; // 256 Mb
+
+// Pool counters (--pool-stats)
+struct io_pool_stats
+{
+    std::size_t hits;        // leases served by a returned buffer
+    std::size_t misses;      // leases which had to allocate
+    std::size_t freed;       // returned buffers freed because of the cap
+    std::size_t cached;      // bytes kept for later leases
+    std::size_t leased_peak; // most bytes leased at once
+};
+
+
+// Process-wide pool of page aligned buffers: readers lease a buffer for a file (or a block) and return it
+// instead of allocating and page faulting fresh memory for every chunk. Thread safe
+class io_buffer_pool
+{
+public:
+    // Leased buffer, returned to the pool on destruction
+    class buffer
+    {
+    public:
+        buffer( io_buffer_pool & pool, io_aligned_ptr data, std::size_t size ) : m_pool( pool ), m_data( std::move( data ) ), m_size( size ) {}
+        buffer( buffer && other ) noexcept : m_pool( other.m_pool ), m_data( std::move( other.m_data ) ), m_size( other.m_size ) {}
+
+        ~buffer()
+        {
+            if (m_data)
+                m_pool.release( std::move( m_data ), m_size );
+        }
+
+        buffer( const buffer & ) = delete;
+        buffer & operator=( const buffer & ) = delete;
+
+        std::uint8_t * data() const { return m_data.get(); }
+        std::size_t size() const { return m_size; }
+
+    private:
+        io_buffer_pool & m_pool;
+        io_aligned_ptr m_data;
+        std::size_t m_size;
+    };
+
+    explicit io_buffer_pool( std::size_t cap = IO_POOL_CAP ) : m_cap( cap ) {}
+
+    void set_cap( std::size_t cap )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_cap = cap;
+    }
+
+    // Back buffers of a huge page or more with transparent huge pages (Linux, ignored elsewhere)
+    void set_huge_pages( bool huge_pages )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_huge_pages = huge_pages;
+    }
+
+    // Lease a buffer of at least size bytes (rounded up to a page)
+    buffer acquire( std::size_t size )
+    {
+        size = (size + IO_PAGE_SIZE - 1) / IO_PAGE_SIZE * IO_PAGE_SIZE;
+        bool huge_pages{ false };
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+
+            m_leased += size;
+            m_stats.leased_peak = std::max( m_stats.leased_peak, m_leased );
+
+            auto & free = m_free[size];
+
+            if (!free.empty())
+            {
+                auto data = std::move( free.back() );
+                free.pop_back();
+
+                m_stats.cached -= size;
+                m_stats.hits++;
+
+                return buffer( *this, std::move( data ), size );
+            }
+
+            m_stats.misses++;
+            huge_pages = m_huge_pages && size >= IO_HUGE_PAGE_SIZE;
+        }
+
+        auto data = io_aligned_alloc( size, huge_pages ? IO_HUGE_PAGE_SIZE : IO_PAGE_SIZE );
+
+        if (!data)
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_leased -= size;
+
+            throw std::bad_alloc();
+        }
+
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+        if (huge_pages)
+            madvise( data.get(), size, MADV_HUGEPAGE );
+#endif
+
+        return buffer( *this, std::move( data ), size );
+    }
+
+    io_pool_stats stats() const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_stats;
+    }
+
+private:
+    void release( io_aligned_ptr data, std::size_t size )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_leased -= size;
+
+        if (m_stats.cached + size > m_cap)
+        {
+            m_stats.freed++;
+            return;
+        }
+
+        m_free[size].push_back( std::move( data ) );
+        m_stats.cached += size;
+    }
+
+    mutable std::mutex m_mutex{};
+    std::map<std::size_t, std::vector<io_aligned_ptr>> m_free{};
+    std::size_t m_cap;
+    std::size_t m_leased{ 0x0 };
+    bool m_huge_pages{ false };
+    io_pool_stats m_stats{};
+};
+
+
+// Buffers of all readers
+inline io_buffer_pool m_buffer_pool{};
+
+
+// File read bypassing the page cache (--io=direct): every read of the inner file starts and ends on
+// IO_DIRECT_ALIGNMENT and goes into a buffer leased from m_buffer_pool, the tail is read up to the boundary and cut.
+// Without bypass (not supported by the file system) the inner file reads through the page cache
+// and every range is dropped from it once it was read
+class direct_file final : public io_file
+{
+public:
+    direct_file( std::unique_ptr<io_file> file, bool bypass ) : m_file( std::move( file ) ), m_bypass( bypass ) {}
+
+    bool size( std::uint64_t & file_size ) override { return m_file->size( file_size ); }
+
+    std::size_t read_at( void * buffer, std::size_t length, std::uint64_t offset ) override
+    {
+        auto const block = m_buffer_pool.acquire( IO_DIRECT_BLOCK );
+        auto const data = static_cast<std::uint8_t *>(buffer);
+        std::size_t total{ 0x0 };
+
+        while (total < length)
+        {
+            auto const position = offset + total;
+            auto const start = position - position % IO_DIRECT_ALIGNMENT;
+            auto const skip = static_cast<std::size_t>(position - start);
+            auto const wanted = align( std::min( length - total + skip, IO_DIRECT_BLOCK ) );
+
+            auto const bytes = m_file->read_at( block.data(), wanted, start );
+
+            if (bytes == IO_ERROR)
+                return IO_ERROR;
+
+            drop( start, bytes );
+
+            // End of the file
+            if (bytes <= skip)
+                break;
+
+            auto const useful = std::min( bytes - skip, length - total );
+            std::memcpy( data + total, block.data() + skip, useful );
+            total += useful;
+
+            if (bytes < wanted)
+                break;
+        }
+
+        return total;
+    }
+
+    bool has_views() const override { return true; }
+
+    bool read_view( std::uint64_t offset, std::uint64_t length, const std::function<void( const void *, std::size_t )> & consume ) override
+    {
+        // Asynchronous reads (io_uring) keep to the boundary themselves
+        if (m_file->has_views() && offset % IO_DIRECT_ALIGNMENT == 0x0)
+        {
+            auto position = offset;
+
+            return m_file->read_view( offset, length, [&] ( const void * data, std::size_t size )
+            {
+                consume( data, size );
+                drop( position, size );
+                position += size;
+            });
+        }
+
+        auto const block = m_buffer_pool.acquire( IO_DIRECT_BLOCK );
+        auto const end = offset + length;
+
+        for (auto position = offset - offset % IO_DIRECT_ALIGNMENT; position < end; position += IO_DIRECT_BLOCK)
+        {
+            auto const wanted = align( static_cast<std::size_t>(std::min<std::uint64_t>( end - position, IO_DIRECT_BLOCK )) );
+            auto const bytes = m_file->read_at( block.data(), wanted, position );
+
+            if (bytes == IO_ERROR)
+                return false;
+
+            drop( position, bytes );
+
+            // The file was truncated while it was read
+            auto const expected = static_cast<std::size_t>(std::min<std::uint64_t>( end - position, wanted ));
+
+            if (bytes < expected)
+                return false;
+
+            auto const skip = static_cast<std::size_t>((offset > position) ? offset - position : 0x0);
+            consume( block.data() + skip, expected - skip );
+        }
+
+        return true;
+    }
+
+    // Nothing of the file is in the page cache when it is bypassed
+    bool advise( io_advice advice, std::uint64_t offset, std::uint64_t length ) override
+    {
+        return !m_bypass && m_file->advise( advice, offset, length );
+    }
+
+    void close() override { m_file->close(); }
+
+private:
+    static std::size_t align( std::size_t length )
+    {
+        return (length + IO_DIRECT_ALIGNMENT - 1) / IO_DIRECT_ALIGNMENT * IO_DIRECT_ALIGNMENT;
+    }
+
+    void drop( std::uint64_t offset, std::size_t length )
+    {
+        if (!m_bypass && length != 0x0)
+            m_file->advise( io_advice::dontneed, offset, length );
+    }
+
+    std::unique_ptr<io_file> m_file;
+    bool m_bypass;
+};
+
+
+#ifdef _WIN32
+// Win32 file handle, positioned reads via OVERLAPPED offsets
+class win32_file : public io_file
+{
+public:
+    explicit win32_file( HANDLE handle ) : m_handle( handle ) {}
+    ~win32_file() override { close(); }
+
+    bool size( std::uint64_t & file_size ) override
+    {
+        LARGE_INTEGER size{};
+
+        if (!GetFileSizeEx( m_handle, &size ))
+            return false;
+
+        file_size = static_cast<std::uint64_t>(size.QuadPart);
+        return true;
+    }
+
+    std::size_t read_at( void * buffer, std::size_t length, std::uint64_t offset ) override
+    {
+        auto const data = static_cast<std::uint8_t *>(buffer);
+        std::size_t total{ 0x0 };
+
+        while (total < length)
+        {
+            // ReadFile takes 32 bit lengths
+            auto const chunk = static_cast<DWORD>(std::min<std::size_t>( length - total, 0x40000000 ));
+            DWORD bytes_read{ 0x0 };
+
+            OVERLAPPED overlapped{};
+            overlapped.Offset = static_cast<DWORD>(offset + total);
+            overlapped.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+
+            if (!ReadFile( m_handle, data + total, chunk, &bytes_read, &overlapped ))
+            {
+                if (GetLastError() == ERROR_HANDLE_EOF)
+                    break;
+
+                return IO_ERROR;
+            }
+
+            if (bytes_read == 0x0)
+                break;
+
+            total += bytes_read;
+        }
+
+        return total;
+    }
+
+    // The file is opened with FILE_FLAG_SEQUENTIAL_SCAN, there are no per-range hints
+    bool advise( io_advice, std::uint64_t, std::uint64_t ) override { return false; }
+
+    void close() override
+    {
+        if (m_handle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle( m_handle );
+            m_handle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+protected:
+    HANDLE m_handle;
+};
+
+
+// Pass the view to consume, false if reading it raised an in-page error (file truncated, network drive gone)
+// No C++ objects with destructors may live in this function because of __try
+inline bool io_consume_guarded( const std::function<void( const void *, std::size_t )> & consume, const void * data, std::size_t length )
+{
+    __try
+    {
+        consume( data, length );
+    }
+    __except (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+// Win32 file read through views of a file mapping
+class win32_mmap_file final : public win32_file
+{
+public:
+    using win32_file::win32_file;
+    ~win32_mmap_file() override { close(); }
+
+    bool has_views() const override { return true; }
+
+    bool read_view( std::uint64_t offset, std::uint64_t length, const std::function<void( const void *, std::size_t )> & consume ) override
+    {
+        if (length == 0x0)
+            return true;
+
+        if (m_mapping == nullptr)
+        {
+            m_mapping = CreateFileMappingW( m_handle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+
+            if (m_mapping == nullptr)
+                return false;
+        }
+
+        // Views start at a multiple of the allocation granularity
+        SYSTEM_INFO info{};
+        GetSystemInfo( &info );
+
+        auto const end = offset + length;
+
+        while (offset < end)
+        {
+            auto const start = offset - offset % info.dwAllocationGranularity;
+            auto const size = static_cast<std::size_t>(std::min<std::uint64_t>( end - start, IO_MAP_WINDOW ));
+
+            auto const view = static_cast<const std::uint8_t *>(MapViewOfFile( m_mapping, FILE_MAP_READ,
+                static_cast<DWORD>(start >> 32), static_cast<DWORD>(start), size ));
+
+            if (view == nullptr)
+                return false;
+
+            // Large pages can't back file mappings, the sequential hint is FILE_FLAG_SEQUENTIAL_SCAN
+            auto const skip = static_cast<std::size_t>(offset - start);
+            auto const result = io_consume_guarded( consume, view + skip, size - skip );
+
+            UnmapViewOfFile( view );
+
+            if (!result)
+                return false;
+
+            offset = start + size;
+        }
+
+        return true;
+    }
+
+    void close() override
+    {
+        if (m_mapping != nullptr)
+        {
+            CloseHandle( m_mapping );
+            m_mapping = nullptr;
+        }
+
+        win32_file::close();
+    }
+
+private:
+    HANDLE m_mapping{ nullptr };
+};
+
+
+// Open the file for sequential reading, INVALID_HANDLE_VALUE on failure
+inline HANDLE win32_open( const std::filesystem::path & path )
+{
+    return CreateFileW( path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+}
+
+
+class win32_backend final : public io_backend
+{
+public:
+    const wchar_t * name() const override { return L"win32"; }
+
+    std::unique_ptr<io_file> open( const std::filesystem::path & path ) override
+    {
+        HANDLE handle = win32_open( path );
+
+        if (handle == INVALID_HANDLE_VALUE)
+            return nullptr;
+
+        return std::make_unique<win32_file>( handle );
+    }
+};
+
+
+class win32_direct_backend final : public io_backend
+{
+public:
+    const wchar_t * name() const override { return L"direct"; }
+
+    std::unique_ptr<io_file> open( const std::filesystem::path & path ) override
+    {
+        HANDLE handle = CreateFileW( path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr,
+            OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING, nullptr );
+
+        if (handle == INVALID_HANDLE_VALUE)
+            return nullptr;
+
+        return std::make_unique<direct_file>( std::make_unique<win32_file>( handle ), true );
+    }
+};
+
+
+class win32_mmap_backend final : public io_backend
+{
+public:
+    const wchar_t * name() const override { return L"mmap"; }
+
+    std::unique_ptr<io_file> open( const std::filesystem::path & path ) override
+    {
+        HANDLE handle = win32_open( path );
+
+        if (handle == INVALID_HANDLE_VALUE)
+            return nullptr;
+
+        return std::make_unique<win32_mmap_file>( handle );
+    }
+};
+#else
+// POSIX file descriptor, positioned reads via pread
+class posix_file : public io_file
+{
+public:
+    explicit posix_file( int fd ) : m_fd( fd ) {}
+    ~posix_file() override { close(); }
+
+    bool size( std::uint64_t & file_size ) override
+    {
+        struct stat info{};
+
+        if (fstat( m_fd, &info ) != 0)
+            return false;
+
+        file_size = static_cast<std::uint64_t>(info.st_size);
+        return true;
+    }
+
+    std::size_t read_at( void * buffer, std::size_t length, std::uint64_t offset ) override
+    {
+        auto const data = static_cast<std::uint8_t *>(buffer);
+        std::size_t total{ 0x0 };
+
+        // pread may return less than requested (signals, pipes, network file systems)
+        while (total < length)
+        {
+            auto const bytes_read = pread( m_fd, data + total, length - total, static_cast<off_t>(offset + total) );
+
+            if (bytes_read < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+
+                return IO_ERROR;
+            }
+
+            if (bytes_read == 0x0)
+                break;
+
+            total += static_cast<std::size_t>(bytes_read);
+        }
+
+        return total;
+    }
+
+    bool advise( io_advice advice, std::uint64_t offset, std::uint64_t length ) override
+    {
+#ifdef POSIX_FADV_SEQUENTIAL
+        int const hints[]{ POSIX_FADV_SEQUENTIAL, POSIX_FADV_WILLNEED, POSIX_FADV_DONTNEED };
+        return posix_fadvise( m_fd, static_cast<off_t>(offset), static_cast<off_t>(length), hints[static_cast<int>(advice)] ) == 0;
+#else
+        static_cast<void>(advice);
+        static_cast<void>(offset);
+        static_cast<void>(length);
+
+        return false;
+#endif
+    }
+
+    void close() override
+    {
+        if (m_fd != -1)
+        {
+            ::close( m_fd );
+            m_fd = -1;
+        }
+    }
+
+protected:
+    int m_fd;
+};
+
+
+// Where the SIGBUS handler returns to while a mapped view is read on this thread
+inline thread_local sigjmp_buf * m_io_sigbus_jump{ nullptr };
+
+// A mapped file that was truncated raises SIGBUS when the missing pages are touched
+inline void io_sigbus_handler( int signal )
+{
+    if (m_io_sigbus_jump != nullptr)
+        siglongjmp( *m_io_sigbus_jump, 1 );
+
+    // Not caused by a view, crash as usual
+    std::signal( signal, SIG_DFL );
+    std::raise( signal );
+}
+
+
+// Pass the view to consume, false if reading it raised SIGBUS
+inline bool io_consume_guarded( const std::function<void( const void *, std::size_t )> & consume, const void * data, std::size_t length )
+{
+    static std::once_flag installed{};
+
+    std::call_once( installed, [] ()
+    {
+        struct sigaction action{};
+        action.sa_handler = io_sigbus_handler;
+        sigemptyset( &action.sa_mask );
+        sigaction( SIGBUS, &action, nullptr );
+    });
+
+    sigjmp_buf jump;
+    auto const previous = m_io_sigbus_jump;
+
+    if (sigsetjmp( jump, 1 ) != 0)
+    {
+        m_io_sigbus_jump = previous;
+        return false;
+    }
+
+    m_io_sigbus_jump = &jump;
+    consume( data, length );
+    m_io_sigbus_jump = previous;
+
+    return true;
+}
+
+
+// POSIX file read through mmap windows
+class posix_mmap_file final : public posix_file
+{
+public:
+    using posix_file::posix_file;
+
+    bool has_views() const override { return true; }
+
+    bool read_view( std::uint64_t offset, std::uint64_t length, const std::function<void( const void *, std::size_t )> & consume ) override
+    {
+        // Mappings start at a multiple of the page size
+        static auto const page_size = static_cast<std::uint64_t>(sysconf( _SC_PAGESIZE ));
+        auto const end = offset + length;
+
+        while (offset < end)
+        {
+            auto const start = offset - offset % page_size;
+            auto const size = static_cast<std::size_t>(std::min<std::uint64_t>( end - start, IO_MAP_WINDOW ));
+
+            auto const view = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, m_fd, static_cast<off_t>(start) );
+
+            if (view == MAP_FAILED)
+                return false;
+
+            // Read-ahead for the whole window, transparent huge pages where the file system supports them
+            madvise( view, size, MADV_SEQUENTIAL );
+#ifdef MADV_HUGEPAGE
+            madvise( view, size, MADV_HUGEPAGE );
+#endif
+
+            auto const skip = static_cast<std::size_t>(offset - start);
+            auto const result = io_consume_guarded( consume, static_cast<const std::uint8_t *>(view) + skip, size - skip );
+
+            munmap( view, size );
+
+            if (!result)
+                return false;
+
+            offset = start + size;
+        }
+
+        return true;
+    }
+};
+
+
+class pread_backend final : public io_backend
+{
+public:
+    const wchar_t * name() const override { return L"pread"; }
+
+    std::unique_ptr<io_file> open( const std::filesystem::path & path ) override
+    {
+        int const fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+
+        if (fd == -1)
+            return nullptr;
+
+        return std::make_unique<posix_file>( fd );
+    }
+};
+
+
+class mmap_backend final : public io_backend
+{
+public:
+    const wchar_t * name() const override { return L"mmap"; }
+
+    std::unique_ptr<io_file> open( const std::filesystem::path & path ) override
+    {
+        int const fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+
+        if (fd == -1)
+            return nullptr;
+
+        return std::make_unique<posix_mmap_file>( fd );
+    }
+};
+
+
+// Queue depth of the ring of every thread: the buffers of the rings of all threads together stay within a share
+// of the physical memory and, down to IO_QUEUE_DEPTH_MIN (plain reads then), within RLIMIT_MEMLOCK so they can
+// be registered
+inline std::size_t io_ring_depth( std::size_t depth, std::size_t threads )
+{
+    auto const share = [threads] ( std::uint64_t bytes ) { return bytes / std::max<std::size_t>( threads, 0x1 ) / IO_URING_BLOCK; };
+    std::uint64_t blocks{ depth };
+    rlimit limit{};
+
+    if (getrlimit( RLIMIT_MEMLOCK, &limit ) == 0 && limit.rlim_cur != RLIM_INFINITY)
+        blocks = std::min<std::uint64_t>( blocks, std::max<std::uint64_t>( share( limit.rlim_cur ), IO_QUEUE_DEPTH_MIN ) );
+
+    auto const pages = sysconf( _SC_PHYS_PAGES );
+    auto const page_size = sysconf( _SC_PAGESIZE );
+
+    if (pages > 0 && page_size > 0)
+        blocks = std::min<std::uint64_t>( blocks, share( static_cast<std::uint64_t>(pages) * static_cast<std::uint64_t>(page_size) / IO_URING_MEMORY_SHARE ) );
+
+    return static_cast<std::size_t>(std::max<std::uint64_t>( blocks, 0x1 ));
+}
+
+
+#ifdef IO_USE_URING
+// io_uring submission and completion queues with one registered buffer per queue entry
+class io_uring_ring
+{
+public:
+    io_uring_ring( std::size_t depth, std::size_t block_size ) : m_depth( depth ), m_block_size( block_size )
+    {
+        io_uring_params params{};
+        m_fd = static_cast<int>(syscall( __NR_io_uring_setup, static_cast<unsigned>(depth), &params ));
+
+        if (m_fd < 0)
+            return;
+
+        m_sq_size = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+        m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+
+        // Both rings share one mapping since 5.4
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+            m_sq_size = m_cq_size = std::max( m_sq_size, m_cq_size );
+
+        m_sq_ring = mmap( nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING );
+        m_cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP) ? m_sq_ring :
+            mmap( nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING );
+        m_sqes_size = params.sq_entries * sizeof( io_uring_sqe );
+        auto const sqes = mmap( nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES );
+
+        if (m_sq_ring == MAP_FAILED || m_cq_ring == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            if (sqes != MAP_FAILED)
+                munmap( sqes, m_sqes_size );
+
+            release();
+            return;
+        }
+
+        auto const sq = static_cast<std::uint8_t *>(m_sq_ring);
+        auto const cq = static_cast<std::uint8_t *>(m_cq_ring);
+
+        m_sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        m_sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+        m_cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        m_cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+        // Page aligned buffers, registered once so the kernel doesn't have to map them for every read
+        if (posix_memalign( reinterpret_cast<void **>(&m_buffers), 4096, depth * block_size ) != 0)
+        {
+            m_buffers = nullptr;
+            release();
+
+            return;
+        }
+
+        std::vector<iovec> iovecs( depth );
+
+        for (std::size_t i = 0x0; i < depth; i++)
+            iovecs[i] = { m_buffers + i * block_size, block_size };
+
+        // Over RLIMIT_MEMLOCK: plain reads into the same buffers
+        m_fixed = syscall( __NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS, iovecs.data(), static_cast<unsigned>(depth) ) == 0;
+    }
+
+    ~io_uring_ring() { release(); }
+
+    io_uring_ring( const io_uring_ring & ) = delete;
+    io_uring_ring & operator=( const io_uring_ring & ) = delete;
+
+    bool valid() const { return m_fd >= 0 && !m_broken; }
+    std::size_t depth() const { return m_depth; }
+    std::size_t block_size() const { return m_block_size; }
+
+    // Registered buffer of queue entry slot
+    std::uint8_t * buffer( std::size_t slot ) const { return m_buffers + slot * m_block_size; }
+
+    // Queue a read, slot is the registered buffer which holds the buffer (-1 = any other memory)
+    // Never fails while no more than depth() reads are in flight
+    void queue_read( int fd, void * buffer, std::size_t length, std::uint64_t offset, std::uint64_t user_data, int slot = -1 )
+    {
+        auto const tail = *m_sq_tail;
+        auto const index = tail & m_sq_mask;
+        auto & sqe = m_sqes[index];
+
+        std::memset( &sqe, 0, sizeof( sqe ) );
+        sqe.opcode = (slot >= 0 && m_fixed) ? IORING_OP_READ_FIXED : IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<std::uint64_t>(buffer);
+        sqe.len = static_cast<unsigned>(length);
+        sqe.off = offset;
+        sqe.user_data = user_data;
+        sqe.buf_index = static_cast<std::uint16_t>((slot >= 0) ? slot : 0);
+
+        m_sq_array[index] = index;
+        __atomic_store_n( m_sq_tail, tail + 1, __ATOMIC_RELEASE );
+        m_queued++;
+    }
+
+    // Submit the queued reads and wait until at least wait of them completed, false on failure
+    bool submit( unsigned wait = 0x0 )
+    {
+        for (;;)
+        {
+            auto const result = syscall( __NR_io_uring_enter, m_fd, m_queued, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0 );
+
+            if (result >= 0)
+            {
+                m_queued -= std::min<unsigned>( m_queued, static_cast<unsigned>(result) );
+                return true;
+            }
+
+            if (errno != EINTR)
+                return false;
+        }
+    }
+
+    // Take the next completion, false if there is none
+    bool complete( std::uint64_t & user_data, int & result )
+    {
+        auto const head = *m_cq_head;
+
+        if (head == __atomic_load_n( m_cq_tail, __ATOMIC_ACQUIRE ))
+            return false;
+
+        auto const& cqe = m_cqes[head & m_cq_mask];
+        user_data = cqe.user_data;
+        result = cqe.res;
+
+        __atomic_store_n( m_cq_head, head + 1, __ATOMIC_RELEASE );
+        return true;
+    }
+
+    // Take back the reads queued and not submitted yet, wait for the ones submitted (of outstanding, both kinds)
+    // and drop their completions, so their buffers can be read into otherwise. False if the reads in flight can't
+    // be waited for, the ring is left broken (valid() is false) then
+    bool cancel( std::size_t outstanding )
+    {
+        // Without SQPOLL the kernel takes the queued entries only in io_uring_enter
+        __atomic_store_n( m_sq_tail, *m_sq_tail - m_queued, __ATOMIC_RELEASE );
+        outstanding -= std::min<std::size_t>( outstanding, m_queued );
+        m_queued = 0x0;
+
+        std::uint64_t user_data{ 0x0 };
+        int result{ 0x0 };
+
+        for (;;)
+        {
+            while (outstanding > 0x0 && complete( user_data, result ))
+                outstanding--;
+
+            if (outstanding == 0x0)
+                return true;
+
+            if (!submit( 0x1 ))
+            {
+                m_broken = true;
+                return false;
+            }
+        }
+    }
+
+private:
+    void release()
+    {
+        if (m_sqes != nullptr)
+            munmap( m_sqes, m_sqes_size );
+
+        if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+            munmap( m_cq_ring, m_cq_size );
+
+        if (m_sq_ring != MAP_FAILED)
+            munmap( m_sq_ring, m_sq_size );
+
+        // Closing the ring waits for the reads still in flight, only then the buffers can go
+        if (m_fd >= 0)
+            ::close( m_fd );
+
+        std::free( m_buffers );
+
+        m_sqes = nullptr;
+        m_sq_ring = m_cq_ring = MAP_FAILED;
+        m_buffers = nullptr;
+        m_fd = -1;
+    }
+
+    int m_fd{ -1 };
+    std::size_t m_depth, m_block_size;
+    bool m_fixed{ false }, m_broken{ false };
+    unsigned m_queued{ 0x0 };
+
+    void * m_sq_ring{ MAP_FAILED };
+    void * m_cq_ring{ MAP_FAILED };
+    std::size_t m_sq_size{ 0x0 }, m_cq_size{ 0x0 }, m_sqes_size{ 0x0 };
+
+    unsigned * m_sq_tail{ nullptr };
+    unsigned * m_sq_array{ nullptr };
+    unsigned m_sq_mask{ 0x0 };
+    io_uring_sqe * m_sqes{ nullptr };
+
+    unsigned * m_cq_head{ nullptr };
+    unsigned * m_cq_tail{ nullptr };
+    unsigned m_cq_mask{ 0x0 };
+    io_uring_cqe * m_cqes{ nullptr };
+
+    std::uint8_t * m_buffers{ nullptr };
+};
+
+
+// One ring per thread, created on first use (again after it broke), nullptr if io_uring isn't available
+// (kernel.io_uring_disabled, seccomp)
+inline std::shared_ptr<io_uring_ring> io_thread_ring( std::size_t depth )
+{
+    thread_local std::shared_ptr<io_uring_ring> ring{};
+
+    if (!ring || !ring->valid() || ring->depth() != depth)
+    {
+        ring = std::make_shared<io_uring_ring>( depth, IO_URING_BLOCK );
+
+        if (!ring->valid())
+            ring.reset();
+    }
+
+    return ring;
+}
+
+
+// POSIX file read through io_uring, queue depth reads in flight and hashed in order
+class uring_file final : public posix_file
+{
+public:
+    // Reads of a file opened with O_DIRECT have to end on alignment too
+    uring_file( int fd, std::shared_ptr<io_uring_ring> ring, std::size_t alignment = 0x1 )
+        : posix_file( fd ), m_ring( std::move( ring ) ), m_alignment( alignment ) {}
+
+    int fd() const { return m_fd; }
+
+    bool has_views() const override { return true; }
+
+    bool read_view( std::uint64_t offset, std::uint64_t length, const std::function<void( const void *, std::size_t )> & consume ) override
+    {
+        auto & ring = *m_ring;
+        auto const depth = ring.depth();
+        auto const block_size = ring.block_size();
+        auto const blocks = (length + block_size - 1) / block_size;
+
+        // Bytes read into every slot so far, whether a read for it is in flight
+        std::vector<std::size_t> filled( depth, 0x0 );
+        std::vector<bool> in_flight( depth, false );
+        std::size_t reads{ 0x0 };
+        bool result{ true };
+
+        auto block_length = [&] ( std::uint64_t block )
+        {
+            return static_cast<std::size_t>(std::min<std::uint64_t>( block_size, length - block * block_size ));
+        };
+
+        // Read the rest of the block (all of it unless the last read was short), the tail up to the alignment
+        auto queue = [&] ( std::uint64_t block )
+        {
+            auto const slot = static_cast<std::size_t>(block % depth);
+            auto const rest = block_length( block ) - filled[slot];
+
+            ring.queue_read( m_fd, ring.buffer( slot ) + filled[slot], (rest + m_alignment - 1) / m_alignment * m_alignment,
+                offset + block * block_size + filled[slot], block, static_cast<int>(slot) );
+
+            in_flight[slot] = true;
+            reads++;
+        };
+
+        std::uint64_t next_queue{ 0x0 };
+
+        for (; next_queue < blocks && next_queue < depth; next_queue++)
+            queue( next_queue );
+
+        for (std::uint64_t block = 0x0; block < blocks && result; block++)
+        {
+            auto const slot = static_cast<std::size_t>(block % depth);
+            auto const size = block_length( block );
+
+            while (result && (in_flight[slot] || filled[slot] < size))
+            {
+                if (!in_flight[slot])
+                    queue( block );
+
+                if (!ring.submit( 0x1 ))
+                {
+                    result = false;
+                    break;
+                }
+
+                std::uint64_t user_data{ 0x0 };
+                int bytes{ 0x0 };
+
+                while (ring.complete( user_data, bytes ))
+                {
+                    auto const done = static_cast<std::size_t>(user_data % depth);
+
+                    in_flight[done] = false;
+                    reads--;
+
+                    // An error, or the end of the file before the expected size (truncated)
+                    if (bytes <= 0)
+                        result = false;
+                    else
+                        filled[done] += static_cast<std::size_t>(bytes);
+                }
+            }
+
+            if (!result)
+                break;
+
+            consume( ring.buffer( slot ), size );
+            filled[slot] = 0x0;
+
+            if (next_queue < blocks)
+            {
+                queue( next_queue++ );
+                result = ring.submit();
+            }
+        }
+
+        // The buffers are reused by the next file, wait for every read still in flight
+        return ring.cancel( reads ) && result;
+    }
+
+private:
+    std::shared_ptr<io_uring_ring> m_ring;
+    std::size_t m_alignment;
+};
+
+
+class uring_backend final : public io_backend
+{
+public:
+    explicit uring_backend( std::size_t queue_depth ) : m_queue_depth( queue_depth ) {}
+
+    const wchar_t * name() const override { return L"uring"; }
+
+    bool available() { return ring() != nullptr; }
+
+    std::unique_ptr<io_file> open( const std::filesystem::path & path ) override
+    {
+        auto file_ring = ring();
+
+        if (!file_ring)
+            return nullptr;
+
+        int const fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+
+        if (fd == -1)
+            return nullptr;
+
+        return std::make_unique<uring_file>( fd, std::move( file_ring ) );
+    }
+
+    // Keep up to queue depth files in flight, hashing can start when all of them are read
+    void read_batch( io_request * requests, std::size_t count ) override
+    {
+        auto batch_ring = ring();
+
+        if (!batch_ring)
+        {
+            io_backend::read_batch( requests, count );
+            return;
+        }
+
+        auto & ring = *batch_ring;
+        std::size_t next{ 0x0 }, reads{ 0x0 };
+
+        auto queue = [&] ( std::size_t i, std::size_t done )
+        {
+            auto & request = requests[i];
+
+            ring.queue_read( static_cast<uring_file *>(request.file)->fd(), static_cast<std::uint8_t *>(request.buffer) + done,
+                request.length - done, request.offset + done, i );
+
+            reads++;
+        };
+
+        for (std::size_t i = 0x0; i < count; i++)
+            requests[i].result = 0x0;
+
+        while (next < count || reads > 0x0)
+        {
+            for (; next < count && reads < ring.depth(); next++)
+            {
+                if (requests[next].length == 0x0)
+                    continue;
+
+                queue( next, 0x0 );
+            }
+
+            if (reads == 0x0)
+                break;
+
+            if (!ring.submit( 0x1 ))
+            {
+                // Nothing can be waited for, read the batch again one file after another, once no read is in flight
+                // into the buffers any more
+                auto const idle = ring.cancel( reads );
+
+                for (std::size_t i = 0x0; i < count; i++)
+                {
+                    requests[i].result = idle ? requests[i].file->read_at( requests[i].buffer, requests[i].length,
+                        requests[i].offset ) : IO_ERROR;
+                }
+
+                return;
+            }
+
+            std::uint64_t user_data{ 0x0 };
+            int bytes{ 0x0 };
+
+            while (ring.complete( user_data, bytes ))
+            {
+                auto & request = requests[user_data];
+                reads--;
+
+                if (request.result == IO_ERROR)
+                    continue;
+
+                if (bytes < 0)
+                    request.result = IO_ERROR;
+                else
+                {
+                    request.result += static_cast<std::size_t>(bytes);
+
+                    // Short read before the end of the file, read the rest
+                    if (bytes > 0 && request.result < request.length)
+                        queue( static_cast<std::size_t>(user_data), request.result );
+                }
+            }
+        }
+    }
+
+private:
+    std::shared_ptr<io_uring_ring> ring() { return io_thread_ring( m_queue_depth ); }
+
+    std::size_t m_queue_depth;
+};
+#endif
+
+
+class direct_backend final : public io_backend
+{
+public:
+    explicit direct_backend( std::size_t queue_depth ) : m_queue_depth( queue_depth ) {}
+
+    const wchar_t * name() const override { return L"direct"; }
+
+    std::unique_ptr<io_file> open( const std::filesystem::path & path ) override
+    {
+        bool bypass{ false };
+        int fd{ -1 };
+
+#ifdef O_DIRECT
+        fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT );
+        bypass = (fd != -1);
+
+        // Not supported by the file system (tmpfs, some FUSE file systems)
+        if (fd == -1 && errno != EINVAL)
+            return nullptr;
+#endif
+
+        if (fd == -1)
+            fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+
+        if (fd == -1)
+            return nullptr;
+
+#ifdef IO_USE_URING
+        // Keeps the device busy while a block is hashed
+        if (auto ring = io_thread_ring( m_queue_depth ))
+        {
+            return std::make_unique<direct_file>( std::make_unique<uring_file>( fd, std::move( ring ),
+                bypass ? IO_DIRECT_ALIGNMENT : 0x1 ), bypass );
+        }
+#endif
+
+        return std::make_unique<direct_file>( std::make_unique<posix_file>( fd ), bypass );
+    }
+
+private:
+    std::size_t m_queue_depth;
+};
+#endif
+
+
+// Decode UTF-8 to wstring (UTF-16 on Windows, UTF-32 elsewhere) without throwing, unlike std::filesystem:
+// every byte which doesn't start a valid sequence becomes U+FFFD. False if there was any
+inline bool utf8_to_wstring( std::string_view str, std::wstring & result )
+{
+    // Smallest code point of a sequence of each length, anything below is an overlong form
+    constexpr char32_t minimum[]{ 0x0, 0x0, 0x80, 0x800, 0x10000 };
+    bool valid{ true };
+
+    result.clear();
+    result.reserve( str.size() );
+
+    for (std::size_t i = 0x0; i < str.size(); )
+    {
+        auto const lead = static_cast<unsigned char>(str[i]);
+        std::size_t length = (lead < 0x80) ? 0x1 : ((lead & 0xE0) == 0xC0) ? 0x2 : ((lead & 0xF0) == 0xE0) ? 0x3 : ((lead & 0xF8) == 0xF0) ? 0x4 : 0x0;
+        char32_t code = (length == 0x1) ? lead : (lead & (0xFF >> (length + 1)));
+        bool decoded = (length != 0x0 && i + length <= str.size());
+
+        for (std::size_t k = 0x1; decoded && k < length; k++)
+        {
+            auto const next = static_cast<unsigned char>(str[i + k]);
+
+            decoded = (next & 0xC0) == 0x80;
+            code = (code << 6) | (next & 0x3F);
+        }
+
+        // Surrogates and code points past U+10FFFF are not characters either
+        if (decoded && (code < minimum[length] || (code >= 0xD800 && code <= 0xDFFF) || code > 0x10FFFF))
+            decoded = false;
+
+        if (!decoded)
+        {
+            valid = false;
+            code = 0xFFFD;
+            length = 0x1;
+        }
+
+        if (sizeof( wchar_t ) == 0x2 && code > 0xFFFF)
+        {
+            result += static_cast<wchar_t>(0xD800 + ((code - 0x10000) >> 10));
+            result += static_cast<wchar_t>(0xDC00 + ((code - 0x10000) & 0x3FF));
+        }
+        else
+            result += static_cast<wchar_t>(code);
+
+        i += length;
+    }
+
+    return valid;
+}
+
+
+// Convert a path to wstring to show it. File names are bytes on POSIX, the ones which aren't UTF-8 show U+FFFD
+// where path::u32string() would throw (open the files with the path itself, not a converted one)
+inline std::wstring path_to_wstring( const std::filesystem::path & path )
+{
+#ifdef _WIN32
+    return path.wstring();
+#else
+    std::wstring result{};
+    utf8_to_wstring( path.native(), result );
+
+    return result;
+#endif
+}
+
+
+// Device holding the file: st_dev on POSIX, the volume on Windows (empty if unknown)
+inline std::wstring io_device_id( const std::filesystem::path & path )
+{
+#ifdef _WIN32
+    wchar_t volume[MAX_PATH]{};
+
+    if (!GetVolumePathNameW( path.c_str(), volume, MAX_PATH ))
+        return {};
+
+    return volume;
+#else
+    struct stat info{};
+
+    if (::stat( path.c_str(), &info ) != 0)
+        return {};
+
+    return std::to_wstring( static_cast<std::uint64_t>(info.st_dev) );
+#endif
+}
+
+
+// Does the device holding the file have to seek (a spinning disk)? False for SSDs and if it is unknown
+// (network shares, virtual file systems): /sys/dev/block on Linux, the seek penalty of the volume on Windows
+inline bool io_device_rotational( const std::filesystem::path & path )
+{
+#ifdef _WIN32
+    wchar_t volume[MAX_PATH]{}, volume_name[MAX_PATH]{};
+
+    if (!GetVolumePathNameW( path.c_str(), volume, MAX_PATH ) || !GetVolumeNameForVolumeMountPointW( volume, volume_name, MAX_PATH ))
+        return false;
+
+    // \\?\Volume{...}\ without the backslash at the end opens the volume itself
+    std::wstring device( volume_name );
+    device.pop_back();
+
+    HANDLE const handle = CreateFileW( device.c_str(), 0x0, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0x0, nullptr );
+
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    STORAGE_PROPERTY_QUERY query{};
+    query.PropertyId = StorageDeviceSeekPenaltyProperty;
+    query.QueryType = PropertyStandardQuery;
+
+    DEVICE_SEEK_PENALTY_DESCRIPTOR seek_penalty{};
+    DWORD bytes{ 0x0 };
+
+    auto const result = DeviceIoControl( handle, IOCTL_STORAGE_QUERY_PROPERTY, &query, sizeof( query ),
+        &seek_penalty, sizeof( seek_penalty ), &bytes, nullptr );
+
+    CloseHandle( handle );
+
+    return result && seek_penalty.IncursSeekPenalty;
+#elif defined(__linux__)
+    struct stat info{};
+
+    // Major 0: no block device (tmpfs, NFS, overlay)
+    if (::stat( path.c_str(), &info ) != 0 || major( info.st_dev ) == 0x0)
+        return false;
+
+    auto const device = "/sys/dev/block/" + std::to_string( major( info.st_dev ) ) + ":" + std::to_string( minor( info.st_dev ) );
+
+    // Partitions have no queue of their own, it belongs to the disk above them
+    for (auto const & queue : { device + "/queue/rotational", device + "/../queue/rotational" })
+    {
+        std::ifstream file( queue );
+        int rotational{ 0x0 };
+
+        if (file >> rotational)
+            return rotational != 0x0;
+    }
+
+    return false;
+#else
+    static_cast<void>(path);
+    return false;
+#endif
+}
+
+
+// Create the I/O backend with the given name (empty = default for this system), nullptr if unknown or not supported
+inline std::unique_ptr<io_backend> make_io_backend( std::wstring_view name, const io_options & options = {} )
+{
+#ifdef _WIN32
+    if (name.empty() || name == L"win32")
+        return std::make_unique<win32_backend>();
+
+    if (name == L"mmap")
+        return std::make_unique<win32_mmap_backend>();
+
+    if (name == L"direct")
+        return std::make_unique<win32_direct_backend>();
+#else
+    if (name.empty() || name == L"pread")
+        return std::make_unique<pread_backend>();
+
+    if (name == L"mmap")
+        return std::make_unique<mmap_backend>();
+
+#ifdef IO_USE_URING
+    if (name == L"uring")
+    {
+        auto backend = std::make_unique<uring_backend>( io_ring_depth( options.queue_depth, options.threads ) );
+        return backend->available() ? std::move( backend ) : nullptr;
+    }
+#endif
+
+    if (name == L"direct")
+        return std::make_unique<direct_backend>( io_ring_depth( options.queue_depth, options.threads ) );
+#endif
+
+    static_cast<void>(options);
+
+    return nullptr;
+}
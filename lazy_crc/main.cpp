@@ -4,10 +4,17 @@
 #include <chrono>
 #include <filesystem>
 #include <map>
+#include <atomic>
+#include <vector>
 #include <mutex>
-#include <io.h>
+#include <thread>
 #include <fcntl.h>
 #include <regex>
+#include <clocale>
+
+#ifdef _WIN32
+#include <io.h>
+#endif
 
 // date (https://github.com/HowardHinnant/date)
 #include <date/date.h>
@@ -18,31 +25,111 @@
 
 // Crc32 (https://github.com/stbrumme/crc32)
 #include <crc32/Crc32.h>
+#include <crc32/CrcEngine.h>
+
+// Kernel benchmark (--benchmark)
+#include "benchmark.h"
+
+// Kernel self-test (--selftest) and libFuzzer entry point
+#include "selftest.h"
+
+// Per-host profile (--autotune)
+#include "autotune.h"
+
+// File access (--io)
+#include "io_backend.h"
+
+// Reader thread (--ring-depth)
+#include "pipeline.h"
+
+// Page cache hints (--cache-policy)
+#include "cache_policy.h"
+
+// Large files hashed in parallel (--segment-size)
+#include "segments.h"
+
+// Files hashed in parallel (-j)
+#include "thread_pool.h"
+
+// Directory listings
+#include "dir_walker.h"
 
 // Common messages
 constexpr const wchar_t * MSG_INFO_VERSION{ L"LazyCRC, {}\n\n" };
-constexpr const wchar_t * MSG_INFO_USAGE{ L"usage: lazy_crc <file|directory>\nor\nlazy_crc <path_to_sfv_file> --check\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_INFO_USAGE{ L"usage: lazy_crc <file|directory> [options]\nor\nlazy_crc <path_to_sfv_file> --check [options]\n\n"
+    L"options:\n"
+    L"  --algo=<name>    checksum algorithm: crc32 (default) or crc32c\n"
+    L"  --kernel=<name>  use the specified CRC32 kernel instead of the fastest one\n"
+    L"  --list-kernels   list the CRC32 kernels and whether this CPU supports them\n"
+    L"  --benchmark      measure the throughput of the CRC32 kernels (or the one given by --kernel),\n"
+    L"                   with a file: compare the I/O backends reading it\n"
+    L"  --benchmark-json=<file>  run the full benchmark suite and save the results as JSON\n"
+    L"  --baseline=<file>        compare the suite to an earlier JSON file, exit code 1 on regressions\n"
+    L"  --selftest       check all CRC32 kernels against the bitwise algorithm, exit code 1 on failures\n"
+    L"  --autotune       find the fastest kernel, prefetch distance and block size for this host and save them\n"
+    L"  --io=<name>      file access method: win32 (default on Windows), pread (default elsewhere), mmap,\n"
+    L"                   uring (Linux) or direct (bypasses the page cache)\n"
+    L"  --queue-depth=<n>  reads kept in flight by --io=uring and --io=direct (default 32, less if memory is short)\n"
+    L"  --ring-depth=<n>   buffers a reader thread fills ahead of hashing (default 4, 1 = no reader thread)\n"
+    L"  --block-size=<n>   fixed read size in bytes, K and M suffixes allowed (default: adapted to the device)\n"
+    L"  --min-read=<n>     smallest read size the adaptation may pick (default 64K)\n"
+    L"  --max-read=<n>     largest read size the adaptation may pick (default 8M)\n"
+    L"  --pool-cap=<n>     memory kept for reuse by the read buffer pool (default 256M)\n"
+    L"  --huge-pages       back read buffers of 2 Mb or more with transparent huge pages (Linux)\n"
+    L"  --pool-stats       print the read buffer pool counters when done\n"
+    L"  --cache-policy=<name>  keep (default) leaves the files hashed in the page cache, drop hints read-ahead\n"
+    L"                   and drops every range once it was hashed (Linux)\n"
+    L"  --split-threshold=<n>  files from this size on are hashed in segments on all cores (default 1G, 0 = never)\n"
+    L"  --segment-size=<n>     size of those segments (default 256M)\n"
+    L"  -j <n>           hash the files of a directory on n threads, same output as one thread (default 1)\n"
+    L"  --hdd-jobs=<n>   files read at once from each spinning disk with -j (default 1)\n\n"
+    L"Press enter to exit the program...\n" };
 constexpr const wchar_t * MSG_INFO_PROCESSING{ L"Processing '{}'\n" };
 constexpr const wchar_t * MSG_INFO_PRESS_ENTER{ L"\nPress enter to exit the program...\n" };
 constexpr const wchar_t * MSG_INFO_ELAPSED_TIME{ L"Elapsed time: {}h {}m {}s {}ms\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_INFO_POOL_STATS{ L"Buffer pool: {} hits, {} misses, {} freed over the cap, {} bytes cached, {} bytes leased at most\n" };
+constexpr const wchar_t * MSG_INFO_CACHE_DROPPED{ L"Page cache: {} bytes dropped after hashing\n" };
+constexpr const wchar_t * MSG_INFO_KERNEL{ L"{} kernel: {}\n\n" };
+constexpr const wchar_t * MSG_INFO_KERNEL_LIST{ L"{} {:<20} {}\n" };
 constexpr const wchar_t * MSG_INFO_SFV_CREATED{ L"SFV file created '{}'\n" };
 constexpr const wchar_t * MSG_INFO_SFV_CHECK_SUCCESS{ L"No errors happened while checking SFV file\n" };
 constexpr const wchar_t * MSG_ERROR_FILE_OPEN{ L"Can not open the specified file '{}'\n" };
+constexpr const wchar_t * MSG_ERROR_FILE_READ{ L"Unable to read the file '{}'\n" };
 constexpr const wchar_t * MSG_ERROR_SFV_CHECK_FAILED{ L"Bad files have been detected, more info inside '{}'\n" };
+constexpr const wchar_t * MSG_ERROR_SFV_LINES{ L"{} line(s) of the SFV file could not be parsed\n" };
 constexpr const wchar_t * MSG_ERROR_NOT_EXIST{ L"The specified file '{}' doesn't exist.\n\nPress enter to exit the program...\n" };
 constexpr const wchar_t * MSG_ERROR_FILESIZE{ L"Unable to obtain the file size for {}\n" };
 constexpr const wchar_t * MSG_ERROR_RELATIVE_PATH{ L"Unable to obtain the relative path for {}\n" };
+constexpr const wchar_t * MSG_ERROR_UNKNOWN_KERNEL{ L"The CRC32 kernel '{}' is unknown or not supported by this CPU, see --list-kernels.\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_UNKNOWN_OPTION{ L"The option '{}' is unknown (a path starting with '-' can be given as ./{}).\n\n" };
+constexpr const wchar_t * MSG_ERROR_UNKNOWN_ALGO{ L"The checksum algorithm '{}' is unknown, use crc32 or crc32c.\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_UNKNOWN_IO{ L"The I/O backend '{}' is unknown or not supported on this system.\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_QUEUE_DEPTH{ L"The queue depth must be between 1 and {}.\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_RING_DEPTH{ L"The ring depth must be between 1 and {}.\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_BLOCK_SIZE{ L"The {} must be between {} and {} bytes.\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_READ_BOUNDS{ L"The minimum read size is larger than the maximum one.\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_JOBS{ L"The number of jobs must be between 1 and {}.\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_SEGMENT_SIZE{ L"The segment size must be between {} and {} bytes.\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_SPLIT_THRESHOLD{ L"The split threshold must be a size in bytes (K, M and G suffixes allowed).\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_POOL_CAP{ L"The pool cap must be a size in bytes (K, M and G suffixes allowed).\n\nPress enter to exit the program...\n" };
+constexpr const wchar_t * MSG_ERROR_CACHE_POLICY{ L"The cache policy '{}' is unknown, use keep or drop.\n\nPress enter to exit the program...\n" };
 constexpr const wchar_t * MSG_ERROR_UNKNOWN_FILE{ L"The specified item is not a regular file or directory.\n\nPress enter to exit the program...\n" };
 
+// Files up to this size are hashed in batches (see crc32_multi)
+constexpr std::size_t SMALL_FILE_SIZE{ 16384 }; // 16 Kb
+constexpr std::size_t SMALL_FILE_BATCH{ 64 };
+
+// SFV comment which stores a non-default checksum algorithm, e.g. "; LazyCRC algorithm: crc32c"
+constexpr const wchar_t * SFV_ALGORITHM_COMMENT{ L"; LazyCRC algorithm: " };
+
 namespace fs = std::filesystem;
 namespace ch = std::chrono;
-namespace detail = fmt::v7::detail;
 
 // Files map
 std::map<fs::path, std::wstring> m_files{};
 
 // Bad files
-std::u16string m_bad_files{};
+std::wstring m_bad_files{};
 
 // Files mutex
 std::mutex m_files_mtx;
@@ -50,12 +137,66 @@ std::mutex m_files_mtx;
 // Should we check the SFV file instead?
 bool m_check_sfv{ false };
 
+// Should we only list the available CRC32 kernels?
+bool m_list_kernels{ false };
+
+// Should we only benchmark the CRC32 kernels?
+bool m_benchmark{ false };
+
+// File access method (--io)
+std::unique_ptr<io_backend> m_io{};
+
+// Should we only tune this host?
+bool m_autotune{ false };
+
+// Fixed read size from --block-size (0 = adapted to the device, read_controller)
+std::size_t m_block_size{ 0x0 };
+
+// Limits of --block-size, --min-read and --max-read
+constexpr std::size_t BLOCK_SIZE_MIN{ 4096 }; // 4 Kb
+constexpr std::size_t BLOCK_SIZE_MAX{ 268435456 }; // 256 Mb
+
+// Buffers between the reader thread and hashing (--ring-depth)
+std::size_t m_ring_depth{ PIPELINE_DEPTH };
+
+// Threads hashing the files of a directory (-j), files read at once from a spinning disk (--hdd-jobs)
+std::size_t m_jobs{ 0x1 };
+std::size_t m_hdd_jobs{ 0x1 };
+
+// Should we print the buffer pool counters?
+bool m_pool_stats{ false };
+
+// Should we only run the self-test?
+bool m_selftest{ false };
+
+// Output of the full benchmark suite and the baseline to compare it to
+fs::path m_benchmark_json{}, m_benchmark_baseline{};
+
+// CRC32 kernel requested on the command line (empty = fastest one)
+std::string m_kernel{};
+
+// Checksum algorithms
+enum class crc_algorithm
+{
+    crc32,  // zlib polynomial, regular SFV files
+    crc32c  // Castagnoli polynomial
+};
 
-// Write the message to console
+// Checksum algorithm in use
+crc_algorithm m_algorithm{ crc_algorithm::crc32 };
+
+// Was the algorithm specified on the command line? (otherwise the SFV file may select it)
+bool m_algorithm_set{ false };
+
+
+// Write the message to console, held back while a task of the thread pool runs (-j)
 template <typename S, typename... Args>
 inline void msg_write( const S & format_str, const Args&... args )
 {
-    fmt::print( format_str, args... );
+    if (m_task_output != nullptr)
+        m_task_output->append( fmt::format( format_str, args... ) );
+    else
+        fmt::print( format_str, args... );
 }
 
 
@@ -75,17 +216,70 @@ inline std::wstring to_hex( T val, size_t width = sizeof( T ) * 2 )
 // Trim the string
 inline std::wstring trim_str( std::wstring str, wchar_t trim_char )
 {
-    while (str.back() == trim_char)
+    while (!str.empty() && str.back() == trim_char)
         str.pop_back();
 
     return str;
 }
 
 
-// Convert u16string to wstring
-inline std::wstring u16_to_wstring( std::u16string_view ustr )
+// Convert wstring to a path
+inline fs::path wstring_to_path( std::wstring_view str )
+{
+#ifdef _WIN32
+    return fs::path( str );
+#else
+    return fs::path( std::u32string( str.begin(), str.end() ) );
+#endif
+}
+
+
+// Convert an ASCII string to wstring
+inline std::wstring ascii_to_wstring( std::string_view str )
+{
+    return std::wstring( str.begin(), str.end() );
+}
+
+
+// Convert an ASCII wstring to string
+inline std::string wstring_to_ascii( std::wstring_view str )
+{
+    std::string result( str.size(), '\0' );
+
+    std::transform( str.begin(), str.end(), result.begin(),
+        []( wchar_t c )
+    {
+        return static_cast<char>(c);
+    });
+
+    return result;
+}
+
+
+// Parse a size in bytes with an optional K, M or G suffix, false if it isn't a number
+inline bool parse_size( std::wstring_view str, std::size_t & size )
 {
-    return std::wstring( ustr.begin(), ustr.end() );
+    std::size_t value{ 0x0 }, digits{ 0x0 };
+
+    for (; digits < str.size() && str[digits] >= L'0' && str[digits] <= L'9'; digits++)
+        value = value * 10 + (str[digits] - L'0');
+
+    if (digits == 0x0)
+        return false;
+
+    auto const suffix = str.substr( digits );
+
+    if (suffix == L"K" || suffix == L"k")
+        value *= 1024;
+    else if (suffix == L"M" || suffix == L"m")
+        value *= 1048576;
+    else if (suffix == L"G" || suffix == L"g")
+        value *= 1073741824;
+    else if (!suffix.empty())
+        return false;
+
+    size = value;
+    return true;
 }
 
 
@@ -102,216 +296,609 @@ inline std::wstring str_to_uppercase( std::wstring str )
 }
 
 
+// Name of the checksum algorithm as used by --algo and the SFV comment
+inline std::wstring algorithm_name( crc_algorithm algorithm )
+{
+    return (algorithm == crc_algorithm::crc32c) ? L"crc32c" : L"crc32";
+}
+
+
+// Parse the checksum algorithm name, returns false if unknown
+inline bool parse_algorithm( std::wstring_view name, crc_algorithm & algorithm )
+{
+    for (auto const candidate : { crc_algorithm::crc32, crc_algorithm::crc32c })
+    {
+        if (name == algorithm_name( candidate ))
+        {
+            algorithm = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// Update the CRC with a data block using the selected algorithm
+inline std::uint32_t crc_update( const void * data, std::size_t length, std::uint32_t crc )
+{
+    if (m_algorithm == crc_algorithm::crc32c)
+        return crc32c_fast( data, length, crc );
+
+    return crc32_fast( data, length, crc );
+}
+
+
+// Combine the CRCs of two consecutive blocks using the selected algorithm, length_b is the length of the second one
+inline std::uint32_t crc_combine( std::uint32_t crc_a, std::uint32_t crc_b, std::size_t length_b )
+{
+    if (m_algorithm == crc_algorithm::crc32c)
+        return Crc32C::combine( crc_a, crc_b, length_b );
+
+    return crc32_combine( crc_a, crc_b, length_b );
+}
+
+
+// Print the algorithm and the kernel in use
+inline void print_kernel()
+{
+    if (m_algorithm == crc_algorithm::crc32c)
+        msg_write( MSG_INFO_KERNEL, L"CRC32C", ascii_to_wstring( crc32c_selected_kernel() ) );
+    else
+        msg_write( MSG_INFO_KERNEL, L"CRC32", ascii_to_wstring( crc32_selected_kernel() ) );
+}
+
+
+// List all the CRC32 kernels, '*' marks the one in use
+inline void list_kernels()
+{
+    std::size_t count{ 0x0 };
+    auto const kernels = crc32_kernels( count );
+    std::string_view const selected = crc32_selected_kernel();
+
+    for (std::size_t i = 0x0; i < count; i++)
+    {
+        msg_write( MSG_INFO_KERNEL_LIST, (kernels[i].name == selected) ? L'*' : L' ',
+            ascii_to_wstring( kernels[i].name ), kernels[i].available ? L"available" : L"not supported" );
+    }
+}
+
+
 // Append the string with 'bad' files (does not exist, invalid CRC etc)
-inline void append_bad_files( std::u16string ustr, std::u16string reason )
+inline void append_bad_files( std::wstring_view name, std::wstring_view reason )
 {
-    m_bad_files += ustr += std::u16string( u" " ) += reason += u"\n";
-    msg_write( u16_to_wstring( m_bad_files ) );
+    m_bad_files.append( name ).append( L" " ).append( reason ).append( L"\n" );
+    msg_write( L"{}", m_bad_files );
 }
 
 
-// Load the file, read it and calculate the CRC
-inline void process_file(
-    const fs::path& path_file,
-    const fs::path& path_dir = "" )
+// Try to open the required file
+inline std::unique_ptr<io_file> try_open_file( const fs::path& file_path )
 {
-    msg_write( MSG_INFO_PROCESSING, path_file.c_str() );
+    auto file = m_io->open( file_path );
 
-    // Try to open the required file
-    auto try_open_file = [] ( const fs::path& file_path ) -> FILE *
+    if (!file)
     {
-        FILE * file;
-        errno_t err = _wfopen_s( &file, file_path.generic_wstring().data(), L"rb" );
+        msg_write( MSG_ERROR_FILE_OPEN, path_to_wstring( file_path ) );
+        return nullptr;
+    }
 
-        if (err != 0)
-        {
-            msg_write( MSG_ERROR_FILE_OPEN, file_path.c_str() );
-            return nullptr;
-        }
+    return file;
+}
 
-        return file;
+
+// Insert the files to the map (including CRC)
+inline void insert_files( const fs::path& file, std::wstring_view crc )
+{
+    std::lock_guard guard( m_files_mtx );
+    m_files.try_emplace( file, crc );
+}
+
+
+// Update the CRC with length bytes of the file from offset on, false on a read error or if the file is shorter
+inline bool hash_range( const fs::path& file_path, io_file& file_in, std::uint64_t offset, std::uint64_t length, std::uint32_t& crc )
+{
+    // Sequential hint, read-ahead and dropping what was hashed with --cache-policy=drop
+    cache_tracker cache( file_in, m_cache_policy, offset );
+
+    auto consume = [&crc, &cache] ( const void * data, std::size_t size )
+    {
+        crc = crc_update( data, size, crc );
+        cache.consumed( size );
     };
 
+    // The backend reads the file itself (mapping, asynchronous reads) and hands it over in place
+    if (file_in.has_views())
+        return file_in.read_view( offset, length, consume );
+
+    // Fixed read size (--block-size), otherwise the controller of the device finds it
+    read_controller fixed( m_block_size, m_block_size, m_block_size );
+    auto & controller = (m_block_size != 0x0) ? fixed : read_controller_for( file_path );
+
+    // A reader thread fills the ring while this one hashes (--ring-depth)
+    return pipelined_read( file_in, offset, length, controller, m_ring_depth, consume );
+}
+
+
+// Load the file, read it and calculate the CRC
+inline void process_file(
+    const fs::path& path_file,
+    const fs::path& path_dir = "" )
+{
+    msg_write( MSG_INFO_PROCESSING, path_to_wstring( path_file ) );
+
     // Get the required file size
-    auto get_file_size = [] ( const fs::path& file_path, FILE * file_in ) -> size_t
+    auto get_file_size = [] ( const fs::path& file_path, io_file& file_in ) -> size_t
     {
-        std::error_code ec;
-        auto size = static_cast<size_t>(fs::file_size( file_path, ec ));
+        std::uint64_t size{ 0x0 };
 
-        if (ec)
+        if (!file_in.size( size ))
         {
-            msg_write( MSG_ERROR_FILESIZE, file_path.c_str() );
-            fclose( file_in );
-
-            return -1;
+            msg_write( MSG_ERROR_FILESIZE, path_to_wstring( file_path ) );
+            return static_cast<size_t>(-1);
         }
 
-        return size;
+        return static_cast<size_t>(size);
     };
 
     // Obtain the relative path
-    auto get_relative_path = [] ( const fs::path& file_path, const fs::path& dir_path, FILE * file_in ) -> fs::path
+    auto get_relative_path = [] ( const fs::path& file_path, const fs::path& dir_path ) -> fs::path
     {
         std::error_code ec;
-        auto relative = fs::path( fs::relative( file_path, dir_path, ec ).u16string() );
+        auto relative = fs::relative( file_path, dir_path, ec );
 
         if (ec)
         {
-            msg_write( MSG_ERROR_RELATIVE_PATH, file_path.c_str() );
-            fclose( file_in );
-
+            msg_write( MSG_ERROR_RELATIVE_PATH, path_to_wstring( file_path ) );
             return fs::path{};
         }
 
         return relative;
     };
 
-    // Calculate the CRC hash
-    auto calculate_crc = [] ( FILE * file_in, const std::size_t& file_size )
+    // Calculate the CRC hash, false if the file can't be read
+    auto calculate_crc = [] ( const fs::path& file_path, io_file& file_in, const std::size_t& file_size, std::uint32_t& crc ) -> bool
     {
-        std::uint32_t crc{ 0x0 };
-        std::size_t bytes_processed{ 0x0 };
+        crc = 0x0;
 
         if (file_size == 0x0)
-            return crc;
-
-        // 64 Kb (default)
-        std::size_t block_size { 65536 };
-
-        // Less than 64 kb
-        if (file_size < 65536)
-            block_size = 4096; // 4 Kb
-
-        // More than 64 Kb and less than 1 Mb
-        else if (file_size > 65536 && file_size < 1048576)
-            block_size = 65536; // 64 Kb
-
-        // More than 1 Mb and less than 256 Mb
-        else if (file_size > 1048576 && file_size < 268435456)
-            block_size = 131072; // 128 Kb
-
-        // More than 256 Mb and less than 500 Mb
-        else if (file_size > 268435456 && file_size < 524288000)
-            block_size = 262144; // 256 Kb
+            return true;
 
-        // More than 500 Mb and less than 1 Gb
-        else if (file_size > 524288000 && file_size < 1073741824)
-            block_size = 1048576; // 1 Mb
+        auto result{ false };
 
-        // More than 1 Gb and less than 4 Gb
-        else if (file_size > 1073741824)
-            block_size = 4194304; // 4 Mb
-
-        while (bytes_processed < file_size)
+        // Large files: segments hashed on worker threads, each with the file opened again for its own positional reads
+        // (not on spinning disks, they would seek between the segments)
+        if (split_file( file_size ) && !io_device_rotational( file_path ))
         {
-            auto bytes_left = file_size - bytes_processed;
-            auto chunk_size = (block_size < bytes_left) ? block_size : bytes_left;
-
-            std::unique_ptr<char[]> buffer( new char[chunk_size] );
-            auto const data = buffer.get();
-
-            fread( data, 1, chunk_size, file_in );
-            crc = crc32_2x16bytes_prefetch( data, chunk_size, crc );
-            buffer.reset();
+            auto const threads = std::max( 0x1u, std::thread::hardware_concurrency() );
 
-            bytes_processed += chunk_size;
+            result = hash_segments( file_size, m_segment_size, threads, [&file_path] ( std::uint64_t offset, std::uint64_t length, std::uint32_t& crc_segment )
+            {
+                auto file_segment = m_io->open( file_path );
+                return file_segment && hash_range( file_path, *file_segment, offset, length, crc_segment );
+            }, crc_combine, crc );
         }
+        else
+            result = hash_range( file_path, file_in, 0x0, file_size, crc );
 
-        return crc;
-    };
+        if (!result)
+            msg_write( MSG_ERROR_FILE_READ, path_to_wstring( file_path ) );
 
-    // Insert the files to the map (including CRC)
-    auto insert_files = [] ( const fs::path& file, std::wstring_view crc )
-    {
-        std::lock_guard guard( m_files_mtx );
-        m_files.try_emplace( file, crc );
+        return result;
     };
 
     auto file = try_open_file( path_file );
 
     if (file)
     {
-        auto size = get_file_size( path_file, file );
+        auto size = get_file_size( path_file, *file );
 
-        if (size != -1)
+        if (size != static_cast<decltype(size)>(-1))
         {
+            std::uint32_t crc{ 0x0 };
+
             if (!path_dir.empty())
             {
-                auto relative = get_relative_path( path_file, path_dir, file );
+                auto relative = get_relative_path( path_file, path_dir );
 
-                if (!relative.empty())
-                {
-                    auto const crc = to_hex( calculate_crc( file, size ) );
-                    insert_files( relative, crc );
-                }
+                if (!relative.empty() && calculate_crc( path_file, *file, size, crc ))
+                    insert_files( relative, to_hex( crc ) );
             }
             else
             {
                 if (m_check_sfv)
                 {
-                    std::basic_ifstream<char16_t> file_sfv( path_file );
+                    std::ifstream file_sfv( path_file );
                     auto const parent_path = path_file.parent_path();
+                    std::size_t line_number{ 0x0 }, unparsed{ 0x0 };
 
-                    // Read all the SFV file contents, line by line
-                    for (std::u16string line; getline( file_sfv, line ); )
+                    // Read all the SFV file contents (UTF-8), line by line
+                    for (std::string line_utf8; getline( file_sfv, line_utf8 ); )
                     {
+                        // CRLF line ends (SFV files written on Windows) and a UTF-8 BOM in front of the first line
+                        if (!line_utf8.empty() && line_utf8.back() == '\r')
+                            line_utf8.pop_back();
+
+                        if (line_number++ == 0x0 && line_utf8.rfind( "\xEF\xBB\xBF", 0x0 ) == 0x0)
+                            line_utf8.erase( 0x0, 0x3 );
+
+                        // Converted line (bytes which aren't UTF-8 become U+FFFD)
+                        std::wstring line{};
+                        utf8_to_wstring( line_utf8, line );
+
                         if (!line.empty())
                         {
-                            if (line.front() != u';') // Exclude comments (QuickSFV style)
+                            // Checksum algorithm written by LazyCRC, unless specified on the command line
+                            if (line.front() == L';' && !m_algorithm_set)
+                            {
+                                std::wstring_view const prefix{ SFV_ALGORITHM_COMMENT };
+
+                                if (line.rfind( prefix, 0x0 ) == 0x0 &&
+                                    parse_algorithm( line.substr( prefix.size() ), m_algorithm ))
+                                    print_kernel();
+                            }
+
+                            if (line.front() != L';') // Exclude comments (QuickSFV style)
                             {
                                 // some_fILE Example.bin DEADC0DE
                                 std::wregex regex( LR"(^(.* )?([a-fA-F0-9]{8})$)", std::wregex::extended );
                                 std::wsmatch regex_match{};
+                                bool parsed{ false };
 
-                                // Converted line
-                                auto line_conv = u16_to_wstring( line );
-
-                                if (std::regex_search( line_conv, regex_match, regex ))
+                                if (std::regex_search( line, regex_match, regex ))
                                 {
-                                    fs::path path_in_sfv = fs::path( trim_str( regex_match[1].str(), ' ' ) );
+                                    auto const name = trim_str( regex_match[1].str(), ' ' );
+#ifdef _WIN32
+                                    fs::path path_in_sfv = wstring_to_path( name );
+#else
+                                    // File names are bytes, the name as written even if it isn't UTF-8 (what follows it is ASCII)
+                                    fs::path path_in_sfv = line_utf8.substr( 0x0, line_utf8.size() - (line.size() - name.size()) );
+#endif
                                     std::wstring crc_in_sfv = str_to_uppercase( regex_match[2].str() );
 
-                                    if (!path_in_sfv.empty() && !crc_in_sfv.empty())
+                                    parsed = !path_in_sfv.empty() && !crc_in_sfv.empty();
+
+                                    if (parsed)
                                     {
                                         auto path_in_sfv_full = parent_path / path_in_sfv;
                                         auto file_crc = try_open_file( path_in_sfv_full );
 
                                         if (!file_crc)
-                                            append_bad_files( path_in_sfv.u16string(), u"Unable to open the file" );
+                                            append_bad_files( path_to_wstring( path_in_sfv ), L"Unable to open the file" );
                                         else
                                         {
-                                            size = get_file_size( path_in_sfv_full, file_crc );
-
-                                            if (size == -1)
-                                                append_bad_files( path_in_sfv.u16string(), u"Unable to obtain the file size" );
-                                            else
-                                            {
-                                                auto const crc = to_hex( calculate_crc( file_crc, size ) );
-
-                                                if (crc != crc_in_sfv)
-                                                    append_bad_files( path_in_sfv.u16string(), u"CRC does not match" );
-                                            }
-
-                                            fclose( file_crc );
+                                            size = get_file_size( path_in_sfv_full, *file_crc );
+
+                                            if (size == static_cast<decltype(size)>(-1))
+                                                append_bad_files( path_to_wstring( path_in_sfv ), L"Unable to obtain the file size" );
+                                            else if (!calculate_crc( path_in_sfv_full, *file_crc, size, crc ))
+                                                append_bad_files( path_to_wstring( path_in_sfv ), L"Unable to read the file" );
+                                            else if (to_hex( crc ) != crc_in_sfv)
+                                                append_bad_files( path_to_wstring( path_in_sfv ), L"CRC does not match" );
                                         }
                                     }
                                 }
+
+                                // Neither an entry nor a comment, the file it stands for can't be checked
+                                if (!parsed)
+                                {
+                                    append_bad_files( fmt::format( L"Line {}", line_number ), L"can not be parsed" );
+                                    unparsed++;
+                                }
                             }
                         }
                     }
 
                     file_sfv.close();
+
+                    if (unparsed != 0x0)
+                        msg_write( MSG_ERROR_SFV_LINES, unparsed );
                 }
-                else
-                {
-                    auto const crc = to_hex( calculate_crc( file, size ) );
-                    insert_files( path_file.filename(), crc );
-                }
+                else if (calculate_crc( path_file, *file, size, crc ))
+                    insert_files( path_file.filename(), to_hex( crc ) );
+            }
+        }
+    }
+}
+
+
+// Load a batch of small files and calculate their CRCs together, the ones found to be larger (listed without
+// a size, see list_directory) are skipped and added to larger with their size
+inline void process_small_files(
+    const std::vector<fs::path>& paths,
+    const fs::path& path_dir,
+    std::vector<std::pair<fs::path, std::uint64_t>>& larger )
+{
+    // Contents of all the files, one after another
+    std::vector<char> data{};
+    std::vector<std::size_t> offsets{}, lengths{};
+    std::vector<fs::path> relatives{}, paths_opened{};
+    std::vector<std::unique_ptr<io_file>> files{};
+
+    for (auto const& path : paths)
+    {
+        auto file = m_io->open( path );
+
+        std::uint64_t file_size{ 0x0 };
+        auto const sized = file && file->size( file_size );
+
+        if (sized && file_size > SMALL_FILE_SIZE)
+        {
+            larger.emplace_back( path, file_size );
+            continue;
+        }
+
+        msg_write( MSG_INFO_PROCESSING, path_to_wstring( path ) );
+
+        std::error_code ec;
+        auto relative = fs::relative( path, path_dir, ec );
+
+        if (ec)
+        {
+            msg_write( MSG_ERROR_RELATIVE_PATH, path_to_wstring( path ) );
+            continue;
+        }
+
+        if (!file)
+        {
+            msg_write( MSG_ERROR_FILE_OPEN, path_to_wstring( path ) );
+            continue;
+        }
+
+        if (!sized)
+        {
+            msg_write( MSG_ERROR_FILESIZE, path_to_wstring( path ) );
+            continue;
+        }
+
+        offsets.push_back( data.size() );
+        lengths.push_back( static_cast<std::size_t>(file_size) );
+        relatives.push_back( relative );
+        paths_opened.push_back( path );
+        files.push_back( std::move( file ) );
+
+        data.resize( data.size() + static_cast<std::size_t>(file_size) );
+    }
+
+    // All the reads at once, the backend may overlap them
+    std::vector<io_request> requests( files.size() );
+
+    for (std::size_t i = 0x0; i < files.size(); i++)
+    {
+        requests[i] = { files[i].get(), data.data() + offsets[i], lengths[i], 0x0, 0x0 };
+
+        // The kernel reads the whole batch ahead while the first files are read
+        if (m_cache_policy == cache_policy::drop)
+            files[i]->advise( io_advice::willneed );
+    }
+
+    m_io->read_batch( requests.data(), requests.size() );
+
+    // The contents are in data now
+    if (m_cache_policy == cache_policy::drop)
+    {
+        for (auto const& request : requests)
+        {
+            if (request.result != IO_ERROR && request.file->advise( io_advice::dontneed ))
+                m_cache_dropped += request.result;
+        }
+    }
+
+    files.clear();
+
+    std::vector<const void *> buffers{};
+    std::vector<std::size_t> buffer_lengths{};
+    std::vector<fs::path> relatives_read{};
+
+    for (std::size_t i = 0x0; i < requests.size(); i++)
+    {
+        if (requests[i].result == IO_ERROR)
+        {
+            msg_write( MSG_ERROR_FILE_READ, path_to_wstring( paths_opened[i] ) );
+            continue;
+        }
+
+        buffers.push_back( requests[i].buffer );
+        buffer_lengths.push_back( requests[i].result );
+        relatives_read.push_back( relatives[i] );
+    }
+
+    std::vector<std::uint32_t> crcs( buffers.size(), 0x0 );
+
+    if (m_algorithm == crc_algorithm::crc32)
+        crc32_multi( buffers.data(), buffer_lengths.data(), crcs.data(), crcs.size() );
+    else
+    {
+        for (std::size_t i = 0x0; i < crcs.size(); i++)
+            crcs[i] = crc_update( buffers[i], buffer_lengths[i], crcs[i] );
+    }
+
+    for (std::size_t i = 0x0; i < crcs.size(); i++)
+        insert_files( relatives_read[i], to_hex( crcs[i] ) );
+}
+
+
+// Queue the segments of a large file on the pool (-j) for the unit, the last one to finish combines their CRCs
+inline void schedule_segments(
+    thread_pool& pool,
+    pool_unit * unit,
+    const fs::path& path_file,
+    const fs::path& path_dir,
+    std::uint64_t file_size,
+    std::size_t group )
+{
+    struct segmented_file
+    {
+        std::vector<std::uint32_t> crcs{};
+        std::atomic<std::size_t> remaining{ 0x0 };
+        std::atomic<bool> failed{ false };
+    };
+
+    auto const segments = segment_count( file_size, m_segment_size );
+    auto const state = std::make_shared<segmented_file>();
+
+    state->crcs.resize( segments, 0x0 );
+    state->remaining = segments;
+
+    // The cost is the size of the file, so all the segments of the largest file come first
+    for (std::size_t segment = 0x0; segment < segments; segment++)
+    {
+        pool.add( unit, file_size, [state, segment, path_file, path_dir, file_size] ()
+        {
+            if (segment == 0x0)
+                msg_write( MSG_INFO_PROCESSING, path_to_wstring( path_file ) );
+
+            // Every segment opens the file itself for its own positional reads
+            auto file = m_io->open( path_file );
+            auto const length = segment_length( file_size, m_segment_size, segment );
+
+            if (!file || !hash_range( path_file, *file, segment * m_segment_size, length, state->crcs[segment] ))
+                state->failed = true;
+
+            if (--state->remaining != 0x0)
+                return;
+
+            if (state->failed)
+            {
+                msg_write( MSG_ERROR_FILE_READ, path_to_wstring( path_file ) );
+                return;
             }
+
+            std::error_code ec;
+            auto relative = fs::relative( path_file, path_dir, ec );
+
+            if (ec)
+            {
+                msg_write( MSG_ERROR_RELATIVE_PATH, path_to_wstring( path_file ) );
+                return;
+            }
+
+            insert_files( relative, to_hex( combine_segments( state->crcs, file_size, m_segment_size, crc_combine ) ) );
+        }, group );
+    }
+}
+
+
+// Directory hashed on the pool and the devices its tree is on
+struct directory_walk
+{
+    // Every device gets its own group of the pool: a spinning disk reads m_hdd_jobs files at once (one sequential
+    // stream by default) and large files on it aren't split, the others read as many as there are threads
+    struct device
+    {
+        std::size_t group;
+        bool rotational;
+    };
+
+    thread_pool& pool;
+    fs::path path_dir;
+    std::size_t walk_group;
+
+    std::map<std::wstring, device> devices{};
+    std::mutex devices_mtx{};
+
+    device device_of( const fs::path& path )
+    {
+        auto const id = io_device_id( path );
+
+        std::lock_guard guard( devices_mtx );
+        auto found = devices.find( id );
+
+        if (found == devices.end())
+        {
+            auto const rotational = io_device_rotational( path );
+            found = devices.emplace( id, device{ pool.group( rotational ? m_hdd_jobs : m_jobs ), rotational } ).first;
         }
 
-        fclose( file );
+        return found->second;
     }
+};
+
+
+// Queue a file of a known size for the node: the segments of a large one on a device without seek penalty
+// (with one job process_file splits it on threads of its own), otherwise the whole file
+inline void schedule_file(
+    directory_walk& walk,
+    pool_node * node,
+    const fs::path& path_file,
+    std::uint64_t file_size,
+    const directory_walk::device& target )
+{
+    auto const unit = walk.pool.unit( node );
+
+    if (m_jobs > 0x1 && !target.rotational && split_file( file_size ))
+        schedule_segments( walk.pool, unit, path_file, walk.path_dir, file_size, target.group );
+    else
+        walk.pool.add( unit, file_size, [&walk, path_file] () { process_file( path_file, walk.path_dir ); }, target.group );
+}
+
+
+// List a directory on the pool and queue its files for hashing right away: small ones and the ones the listing has no
+// size for in batches, the others on their own. Subdirectories are listed by tasks of their own, everything goes into
+// the output node of the directory in the order of the listing
+inline void walk_directory(
+    directory_walk& walk,
+    const fs::path& path,
+    pool_node * node )
+{
+    // A directory that can't be read is skipped
+    std::vector<walk_entry> entries{};
+    list_directory( path, entries );
+
+    // The files are on the device of their directory (mount points are directories)
+    auto const target = walk.device_of( path );
+
+    std::vector<fs::path> small_files{};
+    std::uint64_t small_bytes{ 0x0 };
+
+    auto flush_small_files = [&] ()
+    {
+        if (small_files.empty())
+            return;
+
+        // Files of the batch found to be larger follow it in a node of its own
+        auto const batch_node = walk.pool.node( node );
+        auto const unit = walk.pool.unit( batch_node );
+
+        walk.pool.add( unit, small_bytes, [&walk, batch = std::move( small_files ), batch_node, target] ()
+        {
+            std::vector<std::pair<fs::path, std::uint64_t>> larger{};
+            process_small_files( batch, walk.path_dir, larger );
+
+            for (auto const& [path_file, file_size] : larger)
+                schedule_file( walk, batch_node, path_file, file_size, target );
+
+            walk.pool.close( batch_node );
+        }, target.group );
+
+        small_files.clear();
+        small_bytes = 0x0;
+    };
+
+    for (auto& entry : entries)
+    {
+        if (entry.directory)
+        {
+            auto const child = walk.pool.node( node );
+            walk.pool.add( nullptr, 0x0, [&walk, path_child = std::move( entry.path ), child] () { walk_directory( walk, path_child, child ); }, walk.walk_group );
+        }
+        else if (entry.path.filename() != L"$RECYCLE.BIN")
+        {
+            if (entry.size == WALK_SIZE_UNKNOWN || entry.size <= SMALL_FILE_SIZE)
+            {
+                small_files.push_back( std::move( entry.path ) );
+                small_bytes += (entry.size == WALK_SIZE_UNKNOWN) ? 0x0 : entry.size;
+
+                if (small_files.size() == SMALL_FILE_BATCH)
+                    flush_small_files();
+            }
+            else
+                schedule_file( walk, node, entry.path, entry.size, target );
+        }
+    }
+
+    flush_small_files();
+    walk.pool.close( node );
 }
 
 
@@ -326,11 +913,12 @@ inline void write_sfv(
         {
             auto const bad_files_path = path_sfv.parent_path() / "LazyCRC_BadFiles.log";
 
-            std::wofstream out_bad( bad_files_path );
-            out_bad << u16_to_wstring( m_bad_files );
+            // Written as UTF-8, as the SFV file
+            std::ofstream out_bad( bad_files_path );
+            out_bad << wstring_to_path( m_bad_files ).u8string();
             out_bad.close();
 
-            msg_write( MSG_ERROR_SFV_CHECK_FAILED, bad_files_path.c_str() );
+            msg_write( MSG_ERROR_SFV_CHECK_FAILED, path_to_wstring( bad_files_path ) );
         }
         else
             msg_write( MSG_INFO_SFV_CHECK_SUCCESS );
@@ -348,32 +936,33 @@ inline void write_sfv(
 
             if (file.good() || !file.fail())
             {
-                std::wstringstream data{};
+                std::stringstream data{};
+
+                // Regular SFV readers ignore comments, LazyCRC picks the algorithm up again with --check
+                if (m_algorithm != crc_algorithm::crc32)
+                    data << wstring_to_ascii( SFV_ALGORITHM_COMMENT + algorithm_name( m_algorithm ) ) << std::endl;
 
+                // Paths are written as UTF-8
                 for (auto const& [path, hash] : m_files)
-                    data << path.c_str() << ' ' << hash << std::endl;
+                    data << path.u8string() << ' ' << wstring_to_ascii( hash ) << std::endl;
 
-                auto result = detail::utf16_to_utf8( data.str() );
-                file << result.str();
+                file << data.str();
                 file.close();
 
-                msg_write( MSG_INFO_SFV_CREATED, path_sfv.c_str() );
+                msg_write( MSG_INFO_SFV_CREATED, path_to_wstring( path_sfv ) );
             }
         }
     }
 }
 
 
-int wmain( int argc, wchar_t **argv )
+// Run LazyCRC with the command line arguments (args[0] is the program) and the same arguments as paths, which keep
+// file names that aren't UTF-8 on POSIX (args only shows them)
+inline int run( const std::vector<std::wstring>& args, const std::vector<fs::path>& paths )
 {
-    #pragma warning( push )
-    #pragma warning( disable : 6031)
-    _setmode( _fileno( stdout ), _O_U16TEXT );
-    #pragma warning( pop ) 
-
     msg_write( MSG_INFO_VERSION, L"1.4.0" );
 
-    if (argc < 0x2)
+    if (args.size() < 0x2)
     {
         msg_write( MSG_INFO_USAGE );
         static_cast<void>(std::getchar());
@@ -381,21 +970,276 @@ int wmain( int argc, wchar_t **argv )
         return -1;
     }
 
-    if (argc >= 0x3)
+    // Full path to the operated file or directory
+    fs::path path_file{};
+
+    // File access method (empty = default for this system)
+    std::wstring io_name{};
+    io_options options{};
+
+    // Fixed read size given on the command line (0 = adapted to the device)
+    std::size_t block_size{ 0x0 };
+
+    for (std::size_t i = 0x1; i < args.size(); i++)
     {
-        if (std::wcscmp( argv[2], L"--check" ) == 0x0)
+        std::wstring_view const arg{ args[i] };
+
+        // Path given as the value of the option, the option itself is ASCII
+        auto const option_path = [&] ( const wchar_t * option ) { return fs::path( paths[i].native().substr( std::wcslen( option ) ) ); };
+
+        if (arg == L"--check")
             m_check_sfv = true;
+        else if (arg == L"--list-kernels")
+            m_list_kernels = true;
+        else if (arg == L"--benchmark")
+            m_benchmark = true;
+        else if (arg == L"--selftest")
+            m_selftest = true;
+        else if (arg == L"--autotune")
+            m_autotune = true;
+        else if (arg == L"--huge-pages")
+            m_buffer_pool.set_huge_pages( true );
+        else if (arg == L"--pool-stats")
+            m_pool_stats = true;
+        else if (arg.rfind( L"--benchmark-json=", 0x0 ) == 0x0)
+            m_benchmark_json = option_path( L"--benchmark-json=" );
+        else if (arg.rfind( L"--baseline=", 0x0 ) == 0x0)
+            m_benchmark_baseline = option_path( L"--baseline=" );
+        else if (arg.rfind( L"--io=", 0x0 ) == 0x0)
+            io_name = arg.substr( std::wcslen( L"--io=" ) );
+        else if (arg.rfind( L"--queue-depth=", 0x0 ) == 0x0)
+        {
+            options.queue_depth = std::wcstoul( std::wstring( arg.substr( std::wcslen( L"--queue-depth=" ) ) ).c_str(), nullptr, 10 );
+
+            if (options.queue_depth == 0x0 || options.queue_depth > IO_QUEUE_DEPTH_MAX)
+            {
+                msg_write( MSG_ERROR_QUEUE_DEPTH, IO_QUEUE_DEPTH_MAX );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+        }
+        else if (arg.rfind( L"--ring-depth=", 0x0 ) == 0x0)
+        {
+            m_ring_depth = std::wcstoul( std::wstring( arg.substr( std::wcslen( L"--ring-depth=" ) ) ).c_str(), nullptr, 10 );
+
+            if (m_ring_depth == 0x0 || m_ring_depth > PIPELINE_DEPTH_MAX)
+            {
+                msg_write( MSG_ERROR_RING_DEPTH, PIPELINE_DEPTH_MAX );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+        }
+        else if (arg.rfind( L"--block-size=", 0x0 ) == 0x0 || arg.rfind( L"--min-read=", 0x0 ) == 0x0 || arg.rfind( L"--max-read=", 0x0 ) == 0x0)
+        {
+            auto const separator = arg.find( L'=' );
+            auto const name = arg.substr( 0x2, separator - 0x2 );
+            std::size_t size{ 0x0 };
+
+            if (!parse_size( arg.substr( separator + 1 ), size ) || size < BLOCK_SIZE_MIN || size > BLOCK_SIZE_MAX)
+            {
+                msg_write( MSG_ERROR_BLOCK_SIZE, std::wstring( name ), BLOCK_SIZE_MIN, BLOCK_SIZE_MAX );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+
+            if (name == L"block-size")
+                block_size = size;
+            else if (name == L"min-read")
+                m_read_size_min = size;
+            else
+                m_read_size_max = size;
+        }
+        else if (arg.rfind( L"--pool-cap=", 0x0 ) == 0x0)
+        {
+            std::size_t cap{ 0x0 };
+
+            if (!parse_size( arg.substr( std::wcslen( L"--pool-cap=" ) ), cap ))
+            {
+                msg_write( MSG_ERROR_POOL_CAP );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+
+            m_buffer_pool.set_cap( cap );
+        }
+        else if (arg == L"-j" || (arg.rfind( L"-j", 0x0 ) == 0x0 && arg.size() > 0x2))
+        {
+            // "-j 8" or "-j8"
+            std::wstring const value = (arg.size() > 0x2) ? std::wstring( arg.substr( 0x2 ) ) : ((i + 1 < args.size()) ? args[++i] : L"");
+            m_jobs = std::wcstoul( value.c_str(), nullptr, 10 );
+
+            if (m_jobs == 0x0 || m_jobs > POOL_THREADS_MAX)
+            {
+                msg_write( MSG_ERROR_JOBS, POOL_THREADS_MAX );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+        }
+        else if (arg.rfind( L"--hdd-jobs=", 0x0 ) == 0x0)
+        {
+            m_hdd_jobs = std::wcstoul( std::wstring( arg.substr( std::wcslen( L"--hdd-jobs=" ) ) ).c_str(), nullptr, 10 );
+
+            if (m_hdd_jobs == 0x0 || m_hdd_jobs > POOL_THREADS_MAX)
+            {
+                msg_write( MSG_ERROR_JOBS, POOL_THREADS_MAX );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+        }
+        else if (arg.rfind( L"--segment-size=", 0x0 ) == 0x0)
+        {
+            std::size_t size{ 0x0 };
+
+            if (!parse_size( arg.substr( std::wcslen( L"--segment-size=" ) ), size ) || size < SEGMENT_SIZE_MIN || size > SEGMENT_SIZE_MAX)
+            {
+                msg_write( MSG_ERROR_SEGMENT_SIZE, SEGMENT_SIZE_MIN, SEGMENT_SIZE_MAX );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+
+            // Segments of --io=direct start on the alignment
+            m_segment_size = size - size % IO_DIRECT_ALIGNMENT;
+        }
+        else if (arg.rfind( L"--split-threshold=", 0x0 ) == 0x0)
+        {
+            std::size_t size{ 0x0 };
+
+            if (!parse_size( arg.substr( std::wcslen( L"--split-threshold=" ) ), size ))
+            {
+                msg_write( MSG_ERROR_SPLIT_THRESHOLD );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+
+            m_split_threshold = size;
+        }
+        else if (arg.rfind( L"--cache-policy=", 0x0 ) == 0x0)
+        {
+            auto const name = arg.substr( std::wcslen( L"--cache-policy=" ) );
+
+            if (!parse_cache_policy( name, m_cache_policy ))
+            {
+                msg_write( MSG_ERROR_CACHE_POLICY, std::wstring( name ) );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+        }
+        else if (arg.rfind( L"--kernel=", 0x0 ) == 0x0)
+            m_kernel = wstring_to_ascii( arg.substr( std::wcslen( L"--kernel=" ) ) );
+        else if (arg.rfind( L"--algo=", 0x0 ) == 0x0)
+        {
+            auto const name = arg.substr( std::wcslen( L"--algo=" ) );
+
+            if (!parse_algorithm( name, m_algorithm ))
+            {
+                msg_write( MSG_ERROR_UNKNOWN_ALGO, std::wstring( name ) );
+                static_cast<void>(std::getchar());
+
+                return -1;
+            }
+
+            m_algorithm_set = true;
+        }
+        else if (arg.rfind( L"-", 0x0 ) == 0x0)
+        {
+            // A mistyped option must neither be taken for the path nor be ignored
+            msg_write( MSG_ERROR_UNKNOWN_OPTION, std::wstring( arg ), std::wstring( arg ) );
+            msg_write( MSG_INFO_USAGE );
+            static_cast<void>(std::getchar());
+
+            return -1;
+        }
+        else if (path_file.empty())
+            path_file = paths[i];
     }
 
-    // Full path to the operated file or directory
-    auto path_file = fs::path( fs::path( argv[0x1] ).u16string() );
+    // Every thread reading through io_uring has a ring of its own: one per -j thread, one per core hashing the
+    // segments of a large file
+    options.threads = std::max<std::size_t>( m_jobs, std::thread::hardware_concurrency() );
+    m_io = make_io_backend( io_name, options );
+
+    if (!m_io)
+    {
+        msg_write( MSG_ERROR_UNKNOWN_IO, io_name );
+        static_cast<void>(std::getchar());
+
+        return -1;
+    }
+
+    if (m_autotune)
+        return run_autotune() ? 0x0 : 0x1;
+
+    // Constants tuned for this host, the kernel given on the command line wins
+    tune_profile profile{};
+
+    if (load_profile( profile ))
+    {
+        crc32_select_kernel( profile.kernel.c_str(), false );
+        crc32_set_prefetch_ahead( profile.prefetch );
+        // Where the read size adaptation starts
+        if (profile.block_size != 0x0)
+            m_read_size_initial = profile.block_size;
+
+        msg_write( MSG_INFO_PROFILE, ascii_to_wstring( profile.kernel ), profile.prefetch, profile.block_size );
+    }
+
+    m_block_size = block_size;
+
+    if (m_read_size_min > m_read_size_max)
+    {
+        msg_write( MSG_ERROR_READ_BOUNDS );
+        static_cast<void>(std::getchar());
+
+        return -1;
+    }
+
+    if (!m_kernel.empty() && !crc32_select_kernel( m_kernel.c_str() ))
+    {
+        msg_write( MSG_ERROR_UNKNOWN_KERNEL, ascii_to_wstring( m_kernel ) );
+        static_cast<void>(std::getchar());
+
+        return -1;
+    }
+
+    if (m_list_kernels)
+    {
+        list_kernels();
+        return 0x0;
+    }
+
+    if (m_selftest)
+        return (run_selftest() > 0x0) ? 0x1 : 0x0;
+
+    if (m_benchmark)
+    {
+        // With a file: the I/O backends instead of the kernels
+        if (!path_file.empty())
+            return run_io_benchmark( path_file ) ? 0x0 : 0x1;
+
+        run_benchmark( m_kernel );
+        return 0x0;
+    }
+
+    if (!m_benchmark_json.empty())
+        return (run_benchmark_suite( m_kernel, m_benchmark_json, m_benchmark_baseline ) > 0x0) ? 0x1 : 0x0;
+
+    print_kernel();
 
     // Full path to the output SFV file
     fs::path path_sfv{ path_file.parent_path() / path_file.filename() += ".sfv" };
 
     if (!fs::exists( path_file ))
     {
-        msg_write( MSG_ERROR_NOT_EXIST, path_file.c_str() );
+        msg_write( MSG_ERROR_NOT_EXIST, path_to_wstring( path_file ) );
         static_cast<void>(std::getchar());
 
         return -1;
@@ -408,11 +1252,15 @@ int wmain( int argc, wchar_t **argv )
         path_sfv = path_file / path_file.filename() += ".sfv";
         time_start = ch::steady_clock::now();
 
-        for (auto & entry : fs::recursive_directory_iterator( path_file, fs::directory_options::skip_permission_denied ))
-        {
-            if (entry.is_regular_file() && entry.path().filename() != L"$RECYCLE.BIN")
-                process_file( entry, path_file );
-        }
+        // Files are hashed on m_jobs threads (-j) while the tree is walked: every directory is listed by a task (as
+        // long as few files wait to be hashed) and its files are queued right away, the largest queued ones start
+        // first. The output stays in the order of the listings, as with one thread
+        thread_pool pool( m_jobs );
+        directory_walk walk{ pool, path_file, pool.group( m_jobs, true ) };
+
+        auto const root = pool.root();
+        pool.add( nullptr, 0x0, [&walk, &path_file, root] () { walk_directory( walk, path_file, root ); }, walk.walk_group );
+        pool.run();
 
         time_end = ch::steady_clock::now();
     }
@@ -433,6 +1281,15 @@ int wmain( int argc, wchar_t **argv )
     // Write the output SFV file
     write_sfv( path_sfv );
 
+    if (m_pool_stats)
+    {
+        auto const stats = m_buffer_pool.stats();
+        msg_write( MSG_INFO_POOL_STATS, stats.hits, stats.misses, stats.freed, stats.cached, stats.leased_peak );
+    }
+
+    if (m_cache_policy == cache_policy::drop)
+        msg_write( MSG_INFO_CACHE_DROPPED, m_cache_dropped.load() );
+
     // Output the elapsed time
     auto time = date::make_time( time_end - time_start );
     msg_write( MSG_INFO_ELAPSED_TIME, time.hours().count(), time.minutes().count(),
@@ -440,4 +1297,33 @@ int wmain( int argc, wchar_t **argv )
 
     static_cast<void>(std::getchar());
     return 0x0;
-}
\ No newline at end of file
+}
+
+
+#ifndef LAZY_CRC_FUZZER
+#ifdef _WIN32
+int wmain( int argc, wchar_t **argv )
+{
+    #pragma warning( push )
+    #pragma warning( disable : 6031)
+    _setmode( _fileno( stdout ), _O_U16TEXT );
+    #pragma warning( pop ) 
+
+    return run( std::vector<std::wstring>( argv, argv + argc ), std::vector<fs::path>( argv, argv + argc ) );
+}
+#else
+int main( int argc, char **argv )
+{
+    // Wide console output and UTF-8 arguments / file names
+    std::setlocale( LC_ALL, "" );
+
+    std::vector<std::wstring> args{};
+    std::vector<fs::path> paths( argv, argv + argc );
+
+    for (auto const& path : paths)
+        args.push_back( path_to_wstring( path ) );
+
+    return run( args, paths );
+}
+#endif
+#endif
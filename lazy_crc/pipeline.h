@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// File access methods (io_file)
+#include "io_backend.h"
+
+// Read size per device (read_controller)
+#include "read_size.h"
+
+// Buffers in the ring between the reader thread and the hashing thread (--ring-depth), 1 = no reader thread
+constexpr std::size_t PIPELINE_DEPTH{ 4 };
+constexpr std::size_t PIPELINE_DEPTH_MAX{ 64 };
+
+
+// Buffer size for reading length bytes with the controller: its largest read size, less for smaller files
+// (powers of two, so the pool can reuse the buffers for other files)
+inline std::size_t read_buffer_size( const read_controller & controller, std::uint64_t length )
+{
+    std::size_t size{ IO_PAGE_SIZE };
+
+    while (size < controller.max_size() && size < length)
+        size *= 2;
+
+    return std::min( size, controller.max_size() );
+}
+
+
+// Read length bytes of the file from start on with the read sizes of the controller (every read is measured) and pass
+// them to consume( data, length ) in file order, false on a read error or if the file is shorter than start + length.
+// With depth > 1 a reader thread stays up to depth reads ahead, so reading the next blocks overlaps hashing this one
+inline bool pipelined_read( io_file & file, std::uint64_t start, std::uint64_t length, read_controller & controller, std::size_t depth,
+    const std::function<void( const void *, std::size_t )> & consume )
+{
+    using clock = std::chrono::steady_clock;
+
+    auto const buffer_size = read_buffer_size( controller, length );
+
+    // Read the next block at offset (from start) into the buffer, returns the size asked for and the bytes read
+    auto read_block = [&] ( std::uint8_t * buffer, std::uint64_t offset, std::size_t & bytes )
+    {
+        auto const size = static_cast<std::size_t>(std::min<std::uint64_t>( std::min( controller.size(), buffer_size ), length - offset ));
+        auto const time_start = clock::now();
+
+        bytes = file.read_at( buffer, size, start + offset );
+
+        if (bytes != IO_ERROR)
+            controller.record( bytes, clock::now() - time_start );
+
+        return size;
+    };
+
+    if (depth <= 0x1 || length <= buffer_size)
+    {
+        auto const buffer = m_buffer_pool.acquire( buffer_size );
+
+        for (std::uint64_t offset = 0x0; offset < length; )
+        {
+            std::size_t bytes{ 0x0 };
+            auto const size = read_block( buffer.data(), offset, bytes );
+
+            if (bytes != size)
+                return false;
+
+            consume( buffer.data(), size );
+            offset += size;
+        }
+
+        return true;
+    }
+
+    // Leased from the pool, the next file reuses them
+    std::vector<io_buffer_pool::buffer> buffers{};
+    buffers.reserve( depth );
+
+    while (buffers.size() < depth)
+        buffers.push_back( m_buffer_pool.acquire( buffer_size ) );
+
+    // Size asked for and bytes read of every slot, reads done and hashed so far (guarded by mutex)
+    std::vector<std::size_t> sizes( depth, 0x0 ), filled( depth, 0x0 );
+    std::uint64_t reads_done{ 0x0 }, reads_hashed{ 0x0 };
+    bool stop{ false };
+
+    std::mutex mutex{};
+    std::condition_variable cv_read{}, cv_hashed{};
+
+    std::thread reader( [&] ()
+    {
+        std::uint64_t offset{ 0x0 };
+
+        for (std::uint64_t read = 0x0; offset < length; read++)
+        {
+            auto const slot = static_cast<std::size_t>(read % depth);
+
+            {
+                std::unique_lock<std::mutex> lock( mutex );
+                cv_hashed.wait( lock, [&] { return stop || read - reads_hashed < depth; } );
+
+                if (stop)
+                    return;
+            }
+
+            std::size_t bytes{ 0x0 };
+            auto const size = read_block( buffers[slot].data(), offset, bytes );
+
+            {
+                std::lock_guard<std::mutex> lock( mutex );
+
+                sizes[slot] = size;
+                filled[slot] = bytes;
+                reads_done = read + 1;
+            }
+
+            cv_read.notify_one();
+
+            // The hashing thread stops at this read
+            if (bytes != size)
+                return;
+
+            offset += size;
+        }
+    });
+
+    bool result{ true };
+
+    for (std::uint64_t read = 0x0, offset = 0x0; offset < length; read++)
+    {
+        auto const slot = static_cast<std::size_t>(read % depth);
+
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            cv_read.wait( lock, [&] { return reads_done > read; } );
+        }
+
+        // Read error or truncated file
+        if (filled[slot] != sizes[slot])
+        {
+            result = false;
+            break;
+        }
+
+        consume( buffers[slot].data(), sizes[slot] );
+        offset += sizes[slot];
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            reads_hashed = read + 1;
+        }
+
+        cv_hashed.notify_one();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        stop = true;
+    }
+
+    cv_hashed.notify_one();
+    reader.join();
+
+    return result;
+}
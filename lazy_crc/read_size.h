@@ -0,0 +1,148 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// File access methods (io_device_id)
+#include "io_backend.h"
+
+// Bounds of the read size (--min-read / --max-read) and where every device starts
+constexpr std::size_t READ_SIZE_MIN{ 65536 }; // 64 Kb
+constexpr std::size_t READ_SIZE_MAX{ 8388608 }; // 8 Mb
+constexpr std::size_t READ_SIZE_INITIAL{ 262144 }; // 256 Kb
+
+// Reads per measurement, a larger read size has to be this much faster to be kept
+constexpr std::size_t READ_SIZE_WINDOW{ 8 };
+constexpr double READ_SIZE_GAIN{ 1.10 };
+
+// Reads slower than this on average halve the read size (network mounts, busy disks)
+constexpr std::chrono::milliseconds READ_SIZE_LATENCY{ 100 };
+
+// Throughput below this share of the best one restarts the search (page cache went cold, device got busy)
+constexpr double READ_SIZE_RESTART{ 0.5 };
+
+
+// Read size of one device: doubled from the initial size while every step is measurably faster,
+// halved while reads take too long, kept where the throughput stops improving. Thread safe
+class read_controller
+{
+public:
+    read_controller( std::size_t min_size, std::size_t max_size, std::size_t initial_size )
+        : m_min( min_size ), m_max( max_size ), m_size( std::clamp( initial_size, min_size, max_size ) ) {}
+
+    // Size of the next read
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        return m_size;
+    }
+
+    // Largest size ever returned, for the buffers
+    std::size_t max_size() const { return m_max; }
+
+    // Add a read of bytes which took elapsed
+    void record( std::size_t bytes, std::chrono::steady_clock::duration elapsed )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+
+        // The tail of a file says little about the device
+        if (bytes < m_size / 2)
+            return;
+
+        m_reads++;
+        m_bytes += bytes;
+        m_elapsed += elapsed;
+
+        if (m_reads < READ_SIZE_WINDOW)
+            return;
+
+        auto const seconds = std::max( std::chrono::duration<double>( m_elapsed ).count(), 1e-9 );
+        auto const throughput = m_bytes / seconds;
+        auto const latency = m_elapsed / m_reads;
+
+        m_reads = 0x0;
+        m_bytes = 0x0;
+        m_elapsed = {};
+
+        if (latency > READ_SIZE_LATENCY && m_size > m_min)
+        {
+            m_size = std::max( m_min, m_size / 2 );
+            m_best_size = m_size;
+            m_best_throughput = 0.0;
+            m_settled = true;
+        }
+        else if (!m_settled)
+        {
+            // Still faster: try twice the size, otherwise go back to the best one and stay there
+            if (throughput > m_best_throughput * READ_SIZE_GAIN)
+            {
+                m_best_size = m_size;
+                m_best_throughput = throughput;
+
+                if (m_size < m_max)
+                    m_size = std::min( m_max, m_size * 2 );
+                else
+                    m_settled = true;
+            }
+            else
+            {
+                m_size = m_best_size;
+                m_settled = true;
+            }
+        }
+        else if (throughput > m_best_throughput)
+            m_best_throughput = throughput;
+        else if (throughput < m_best_throughput * READ_SIZE_RESTART && m_size < m_max)
+        {
+            m_best_size = m_size;
+            m_best_throughput = throughput;
+            m_size = std::min( m_max, m_size * 2 );
+            m_settled = false;
+        }
+    }
+
+private:
+    mutable std::mutex m_mutex{};
+    std::size_t m_min, m_max, m_size;
+
+    // Best size measured so far
+    std::size_t m_best_size{ 0x0 };
+    double m_best_throughput{ 0.0 };
+    bool m_settled{ false };
+
+    // Current measurement
+    std::size_t m_reads{ 0x0 };
+    std::uint64_t m_bytes{ 0x0 };
+    std::chrono::steady_clock::duration m_elapsed{};
+};
+
+
+// Bounds for new controllers (--min-read, --max-read, the autotune profile)
+inline std::size_t m_read_size_min{ READ_SIZE_MIN };
+inline std::size_t m_read_size_max{ READ_SIZE_MAX };
+inline std::size_t m_read_size_initial{ READ_SIZE_INITIAL };
+
+// One controller per device, kept for the whole run
+inline std::mutex m_read_controllers_mutex{};
+inline std::map<std::wstring, std::unique_ptr<read_controller>> m_read_controllers{};
+
+
+// Controller of the device holding the file
+inline read_controller & read_controller_for( const std::filesystem::path & path )
+{
+    auto const device = io_device_id( path );
+
+    std::lock_guard<std::mutex> lock( m_read_controllers_mutex );
+    auto & controller = m_read_controllers[device];
+
+    if (!controller)
+        controller = std::make_unique<read_controller>( m_read_size_min, m_read_size_max, m_read_size_initial );
+
+    return *controller;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Files from this size on are split into segments hashed on worker threads (--split-threshold, 0 = never)
+constexpr std::uint64_t SEGMENT_THRESHOLD{ 1073741824 }; // 1 Gb
+
+// Size of every segment but the last one (--segment-size), a multiple of the direct I/O alignment
+constexpr std::uint64_t SEGMENT_SIZE{ 268435456 }; // 256 Mb
+constexpr std::uint64_t SEGMENT_SIZE_MIN{ 1048576 }; // 1 Mb
+constexpr std::uint64_t SEGMENT_SIZE_MAX{ 1073741824 }; // 1 Gb
+
+// Segment settings in use
+inline std::uint64_t m_split_threshold{ SEGMENT_THRESHOLD };
+inline std::uint64_t m_segment_size{ SEGMENT_SIZE };
+
+
+// Is the file large enough to be split into segments?
+inline bool split_file( std::uint64_t length )
+{
+    return m_split_threshold != 0x0 && length >= m_split_threshold && length > m_segment_size;
+}
+
+
+// Number of segments of length bytes and the length of one of them
+inline std::size_t segment_count( std::uint64_t length, std::uint64_t segment_size )
+{
+    return static_cast<std::size_t>((length + segment_size - 1) / segment_size);
+}
+
+inline std::uint64_t segment_length( std::uint64_t length, std::uint64_t segment_size, std::size_t segment )
+{
+    return std::min( segment_size, length - segment * segment_size );
+}
+
+
+// CRC of the whole range from the CRCs of its segments (each one from a new CRC), in file order.
+// combine( crc_a, crc_b, length_b ) appends a CRC to another one
+inline std::uint32_t combine_segments( const std::vector<std::uint32_t> & crcs, std::uint64_t length, std::uint64_t segment_size,
+    const std::function<std::uint32_t( std::uint32_t, std::uint32_t, std::size_t )> & combine )
+{
+    std::uint32_t crc{ 0x0 };
+
+    for (std::size_t segment = 0x0; segment < crcs.size(); segment++)
+    {
+        crc = (segment == 0x0) ? crcs[0] : combine( crc, crcs[segment],
+            static_cast<std::size_t>(segment_length( length, segment_size, segment )) );
+    }
+
+    return crc;
+}
+
+
+// Hash length bytes in segments of segment_size on up to threads threads (this one included).
+// hash( offset, length, crc ) hashes one segment from a new CRC with its own positional reads,
+// combine as for combine_segments, false if any segment failed
+inline bool hash_segments( std::uint64_t length, std::uint64_t segment_size, std::size_t threads,
+    const std::function<bool( std::uint64_t, std::uint64_t, std::uint32_t & )> & hash,
+    const std::function<std::uint32_t( std::uint32_t, std::uint32_t, std::size_t )> & combine, std::uint32_t & crc )
+{
+    auto const segments = segment_count( length, segment_size );
+
+    std::vector<std::uint32_t> crcs( segments, 0x0 );
+    std::atomic<std::size_t> next{ 0x0 };
+    std::atomic<bool> failed{ false };
+
+    // Segments are taken in file order, the device sees reads close to each other
+    auto worker = [&] ()
+    {
+        for (std::size_t segment = next++; segment < segments && !failed; segment = next++)
+        {
+            if (!hash( segment * segment_size, segment_length( length, segment_size, segment ), crcs[segment] ))
+                failed = true;
+        }
+    };
+
+    std::vector<std::thread> workers{};
+
+    for (std::size_t i = 0x1; i < std::min( threads, segments ); i++)
+        workers.emplace_back( worker );
+
+    worker();
+
+    for (auto & thread : workers)
+        thread.join();
+
+    if (failed)
+        return false;
+
+    crc = combine_segments( crcs, length, segment_size, combine );
+    return true;
+}
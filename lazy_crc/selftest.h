@@ -0,0 +1,343 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// {fmt} (https://github.com/fmtlib/fmt)
+#include <fmt/format.h>
+
+// Crc32 (https://github.com/stbrumme/crc32)
+#include <crc32/Crc32.h>
+#include <crc32/CrcEngine.h>
+
+// Order the pool starts its tasks in
+#include "thread_pool.h"
+
+// Self-test messages
+constexpr const wchar_t * MSG_SELFTEST_FAILED{ L"{:<28} length {}, offset {}, split {}, previous CRC {:08X}: {:08X} instead of {:08X}\n" };
+constexpr const wchar_t * MSG_SELFTEST_RESULT{ L"\nSelf-test: {} checks, {} failed\n" };
+
+// Random buffers checked after the fixed lengths 0 to SELFTEST_FIXED_LENGTHS
+constexpr std::size_t SELFTEST_FIXED_LENGTHS{ 1024 };
+constexpr std::size_t SELFTEST_RANDOM_BUFFERS{ 2000 };
+constexpr std::size_t SELFTEST_MAX_LENGTH{ 70000 };
+
+// Look-ahead values for the prefetching kernels
+constexpr std::size_t SELFTEST_PREFETCH[]{ 0, 64, 256, 1024 };
+
+// Tasks and threads of the thread pool check
+constexpr std::size_t SELFTEST_POOL_TASKS{ 24 };
+constexpr std::size_t SELFTEST_POOL_THREADS{ 4 };
+
+// Number of comparisons made so far
+inline std::size_t m_selftest_checks{ 0x0 };
+
+
+// Compare a result to the reference (CRCs up to 64 bits), print the failure
+inline bool selftest_check( std::string_view name, std::uint64_t result, std::uint64_t expected,
+    std::size_t length, std::size_t offset, std::size_t split, std::uint32_t previous )
+{
+    m_selftest_checks++;
+
+    if (result == expected)
+        return true;
+
+    fmt::print( MSG_SELFTEST_FAILED, std::wstring( name.begin(), name.end() ), length, offset, split, previous, result, expected );
+    return false;
+}
+
+
+// Check every available kernel, chained calls and the combine functions against crc32_bitwise for one buffer,
+// split is where the buffer is cut in two (offset is only used for reporting), returns the number of failures
+inline std::size_t selftest_buffer( const std::uint8_t * data, std::size_t length, std::uint32_t previous,
+    std::size_t split, std::size_t offset = 0x0 )
+{
+    std::size_t failed{ 0x0 };
+
+    auto check = [&] ( std::string_view name, std::uint32_t result, std::uint32_t expected )
+    {
+        if (!selftest_check( name, result, expected, length, offset, split, previous ))
+            failed++;
+    };
+
+    auto const head = split;
+    auto const tail = length - split;
+    auto const expected = crc32_bitwise( data, length, previous );
+
+    // Every kernel in one go, chained at the split point and bound to crc32_fast (size classes, unaligned heads)
+    std::string const selected = crc32_selected_kernel();
+    auto const pinned = crc32_kernel_pinned();
+
+    std::size_t count{ 0x0 };
+    auto const kernels = crc32_kernels( count );
+
+    for (std::size_t i = 0x0; i < count; i++)
+    {
+        if (!kernels[i].available)
+            continue;
+
+        std::string const name = kernels[i].name;
+        auto const function = kernels[i].function;
+
+        check( name, function( data, length, previous ), expected );
+        check( name + " chained", function( data + head, tail, function( data, head, previous ) ), expected );
+
+        crc32_select_kernel( kernels[i].name );
+        check( name + " crc32_fast", crc32_fast( data, length, previous ), expected );
+
+        // The pinned kernel hashes every buffer of crc32_multi
+        const void * const buffers[]{ data };
+        std::uint32_t multi_crcs[]{ previous };
+
+        crc32_multi( buffers, &length, multi_crcs, 1 );
+        check( name + " crc32_multi", multi_crcs[0], expected );
+    }
+
+    crc32_select_kernel( selected.c_str(), pinned );
+
+    // Prefetching kernels with other look-ahead values
+    for (auto const prefetch : SELFTEST_PREFETCH)
+    {
+        check( "16bytes_prefetch " + std::to_string( prefetch ), crc32_16bytes_prefetch( data, length, previous, prefetch ), expected );
+        check( "2x16bytes_prefetch " + std::to_string( prefetch ), crc32_2x16bytes_prefetch( data, length, previous, prefetch ), expected );
+    }
+
+    // Slicing-by-16 of big endian CPUs, on the words such a CPU loads from the whole 16 byte slices of the buffer
+    // (most significant byte first), the rest bytewise
+    std::vector<std::uint32_t> words( length / 16 * 4 );
+
+    for (std::size_t i = 0x0; i < words.size(); i++)
+    {
+        words[i] = (static_cast<std::uint32_t>(data[4 * i]) << 24) | (static_cast<std::uint32_t>(data[4 * i + 1]) << 16) |
+            (static_cast<std::uint32_t>(data[4 * i + 2]) << 8) | data[4 * i + 3];
+    }
+
+    auto const sliced = words.size() * 4;
+    check( "16bytes big endian", crc32_bitwise( data + sliced, length - sliced, crc32_16bytes_big_endian( words.data(), sliced, previous ) ), expected );
+
+    // Split and reconstructed by crc32_combine, crc32_shift and crc32_combine_n (three parts)
+    auto const crc_head = crc32_bitwise( data, head, previous );
+    auto const crc_tail = crc32_bitwise( data + head, tail );
+
+    check( "crc32_combine", crc32_combine( crc_head, crc_tail, tail ), expected );
+    check( "crc32_shift", crc32_shift( crc_head, tail ) ^ crc_tail, expected );
+
+    std::size_t const lengths[]{ head / 2, head - head / 2, tail };
+    std::uint32_t const crcs[]{ crc32_bitwise( data, lengths[0], previous ),
+        crc32_bitwise( data + lengths[0], lengths[1] ), crc_tail };
+
+    check( "crc32_combine_n", crc32_combine_n( crcs, lengths, 3 ), expected );
+
+    // Multi-buffer API, the second buffer continues the first one
+    const void * const buffers[]{ data, data, data + head };
+    std::size_t const multi_lengths[]{ length, head, tail };
+    std::uint32_t multi_crcs[]{ previous, previous, crc_head };
+
+    crc32_multi( buffers, multi_lengths, multi_crcs, 3 );
+    check( "crc32_multi", multi_crcs[0], expected );
+    check( "crc32_multi head", multi_crcs[1], crc_head );
+    check( "crc32_multi tail", multi_crcs[2], expected );
+
+    // Generic engine with the zlib parameters
+    check( "CrcEngine zlib", Crc32Zlib::calculate( data, length, previous ), expected );
+    check( "CrcEngine zlib combine", Crc32Zlib::combine( crc_head, crc_tail, tail ), expected );
+
+    // CRC32C against the bitwise engine
+    auto const expected_c = Crc32C::bitwise( data, length, previous );
+
+    check( "crc32c_16bytes", crc32c_16bytes( data, length, previous ), expected_c );
+    check( "crc32c_fast", crc32c_fast( data, length, previous ), expected_c );
+    check( "crc32c_fast chained", crc32c_fast( data + head, tail, crc32c_fast( data, head, previous ) ), expected_c );
+
+    return failed;
+}
+
+
+// Check a catalogue entry of the generic engine against its check value (CRC of "123456789"): the bitwise
+// reference, slicing, prefetching, a chained call and combine. Returns the number of failures
+template <typename Engine>
+inline std::size_t selftest_engine( std::string_view name, std::uint64_t check_value )
+{
+    auto const data = reinterpret_cast<const std::uint8_t *>("123456789");
+    std::size_t failed{ 0x0 };
+
+    auto check = [&] ( std::string_view variant, std::uint64_t result )
+    {
+        if (!selftest_check( std::string( name ) += variant, result, check_value, 9, 0, 4, 0 ))
+            failed++;
+    };
+
+    auto const head = Engine::calculate( data, 4 );
+
+    check( " bitwise", Engine::bitwise( data, 9 ) );
+    check( "", Engine::calculate( data, 9 ) );
+    check( " prefetch", Engine::calculate_prefetch( data, 9 ) );
+    check( " chained", Engine::calculate( data + 4, 5, head ) );
+    check( " combine", Engine::combine( head, Engine::calculate( data + 4, 5 ), 5 ) );
+
+    return failed;
+}
+
+
+// Check that the pool starts the most expensive tasks first, also when a task queued them (the directory walk) from
+// the cheapest on. Returns the number of tasks started a round of threads or more away from their place
+inline std::size_t selftest_pool_order()
+{
+    thread_pool pool( SELFTEST_POOL_THREADS );
+    auto const feeder = pool.group( SELFTEST_POOL_THREADS, true );
+
+    std::mutex mutex{};
+    std::condition_variable cv_queued{};
+    bool queued{ false };
+    std::vector<std::uint64_t> started{};
+
+    // The other workers wait until every task is queued
+    for (std::size_t i = 0x1; i < SELFTEST_POOL_THREADS; i++)
+    {
+        pool.add( nullptr, 0x0, [&] ()
+        {
+            std::unique_lock<std::mutex> lock( mutex );
+            cv_queued.wait( lock, [&] { return queued; } );
+        });
+    }
+
+    pool.add( nullptr, 0x0, [&] ()
+    {
+        for (std::uint64_t cost = 0x1; cost <= SELFTEST_POOL_TASKS; cost++)
+        {
+            pool.add( nullptr, cost, [&, cost] ()
+            {
+                {
+                    std::lock_guard<std::mutex> lock( mutex );
+                    started.push_back( cost );
+                }
+
+                // Long enough for the other workers to start theirs meanwhile
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            });
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            queued = true;
+        }
+
+        cv_queued.notify_all();
+    }, feeder );
+
+    pool.run();
+
+    // Tasks started at the same time may record themselves in any order
+    std::size_t misplaced{ SELFTEST_POOL_TASKS - started.size() };
+
+    for (std::size_t i = 0x0; i < started.size(); i++)
+    {
+        auto const place = static_cast<std::size_t>(SELFTEST_POOL_TASKS - started[i]);
+
+        if ((i > place ? i - place : place - i) >= SELFTEST_POOL_THREADS)
+            misplaced++;
+    }
+
+    return misplaced;
+}
+
+
+// Check all kernels with fixed and random lengths, misaligned buffers and previous CRCs, returns the number of failures
+inline std::size_t run_selftest()
+{
+    std::vector<std::uint8_t> buffer( SELFTEST_MAX_LENGTH + 64 );
+    std::mt19937 random{};
+
+    for (auto & byte : buffer)
+        byte = static_cast<std::uint8_t>(random());
+
+    std::size_t failed{ 0x0 };
+
+    // Known answers
+    auto const check_value = reinterpret_cast<const std::uint8_t *>("123456789");
+
+    if (!selftest_check( "crc32 check value", crc32_bitwise( check_value, 9 ), 0xCBF43926, 9, 0, 0, 0 ))
+        failed++;
+
+    if (!selftest_check( "crc32c check value", Crc32C::bitwise( check_value, 9 ), 0xE3069283, 9, 0, 0, 0 ))
+        failed++;
+
+    // Every parameter set of the generic engine (CrcEngine.h)
+    failed += selftest_engine<Crc32Zlib>( "CRC-32", 0xCBF43926 );
+    failed += selftest_engine<Crc32C>( "CRC-32C", 0xE3069283 );
+    failed += selftest_engine<Crc32Bzip2>( "CRC-32/BZIP2", 0xFC891918 );
+    failed += selftest_engine<Crc64Xz>( "CRC-64/XZ", 0x995DC9BBDF1939FA );
+    failed += selftest_engine<Crc64Ecma>( "CRC-64/ECMA-182", 0x6C40DF5F0B497347 );
+
+    // Previous CRCs: a new CRC, all bits set and random ones
+    auto previous_crc = [&] ( std::size_t i ) -> std::uint32_t
+    {
+        switch (i % 3)
+        {
+            case 0: return 0x0;
+            case 1: return 0xFFFFFFFF;
+            default: return static_cast<std::uint32_t>(random());
+        }
+    };
+
+    for (std::size_t length = 0x0; length <= SELFTEST_FIXED_LENGTHS; length++)
+    {
+        auto const offset = length % 64;
+        failed += selftest_buffer( buffer.data() + offset, length, previous_crc( length ), random() % (length + 1), offset );
+    }
+
+    for (std::size_t i = 0x0; i < SELFTEST_RANDOM_BUFFERS; i++)
+    {
+        // Mostly short buffers, where the tails and size classes are
+        std::size_t length{ random() };
+
+        switch (i % 4)
+        {
+            case 0:
+            case 1: length %= 512; break;
+            case 2: length %= 8192; break;
+            default: length %= SELFTEST_MAX_LENGTH + 1; break;
+        }
+
+        auto const offset = random() % 64;
+        failed += selftest_buffer( buffer.data() + offset, length, previous_crc( i ), random() % (length + 1), offset );
+    }
+
+    if (!selftest_check( "thread_pool start order", static_cast<std::uint32_t>(selftest_pool_order()), 0x0, SELFTEST_POOL_TASKS, 0, 0, 0 ))
+        failed++;
+
+    fmt::print( MSG_SELFTEST_RESULT, m_selftest_checks, failed );
+
+    return failed;
+}
+
+
+#ifdef LAZY_CRC_FUZZER
+// libFuzzer entry point, build with -DLAZY_CRC_FUZZER -fsanitize=fuzzer (the fuzzer provides main)
+extern "C" int LLVMFuzzerTestOneInput( const std::uint8_t * data, std::size_t size )
+{
+    // The first 8 bytes select the previous CRC and the split point
+    std::uint32_t previous{ 0x0 }, split{ 0x0 };
+
+    if (size >= 8)
+    {
+        std::memcpy( &previous, data, 4 );
+        std::memcpy( &split, data + 4, 4 );
+        data += 8;
+        size -= 8;
+    }
+
+    if (selftest_buffer( data, size, previous, split % (size + 1) ) != 0x0)
+        std::abort();
+
+    return 0;
+}
+#endif
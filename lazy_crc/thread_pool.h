@@ -0,0 +1,365 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// {fmt} (https://github.com/fmtlib/fmt)
+#include <fmt/format.h>
+
+// Limit of -j
+constexpr std::size_t POOL_THREADS_MAX{ 256 };
+
+// Groups (devices) of a pool, the tasks of any further ones go to group 0
+constexpr std::size_t POOL_GROUPS_MAX{ 64 };
+
+// Tasks waiting per thread before the feeding tasks (the directory walk) let hashing catch up
+constexpr std::size_t POOL_BACKLOG{ 4 };
+
+// Console output of the task running on this thread (nullptr = print right away)
+inline thread_local std::wstring * m_task_output{ nullptr };
+
+
+// Output of the tasks of a file or a batch of small files, printed once all of them are done
+struct pool_unit
+{
+    std::vector<std::wstring> output{}; // one per task, in the order they were added
+    std::size_t remaining{ 0x0 };
+};
+
+// Place in the output (a directory): units and nodes in the order they are printed,
+// nothing of it is printed before it is closed (everything in it was added)
+struct pool_node
+{
+    struct child
+    {
+        std::unique_ptr<pool_unit> unit{};
+        std::unique_ptr<pool_node> node{};
+    };
+
+    std::vector<child> children{};
+    bool closed{ false };
+};
+
+
+// Pool of workers sharing a queue per group, ordered by cost: whichever worker is free next starts the most
+// expensive task waiting, no matter which thread added it. Tasks may add more tasks while the pool runs. A group
+// (a device) runs at most its limit of tasks at once, feeding groups (the directory walk) are preferred until
+// POOL_BACKLOG tasks per thread wait.
+// The console output of the tasks (m_task_output) is printed in the order of the output tree, as if they
+// ran one after another
+class thread_pool
+{
+public:
+    explicit thread_pool( std::size_t threads ) : m_threads( std::max<std::size_t>( threads, 0x1 ) )
+    {
+        group( m_threads );
+    }
+
+    thread_pool( const thread_pool & ) = delete;
+    thread_pool & operator=( const thread_pool & ) = delete;
+
+    // Add a group running at most limit tasks at once, returns its number (group 0 runs on all threads)
+    std::size_t group( std::size_t limit, bool feeder = false )
+    {
+        std::lock_guard<std::mutex> lock( m_groups_mutex );
+        auto const count = m_group_count.load();
+
+        if (count == POOL_GROUPS_MAX)
+            return 0x0;
+
+        m_groups[count] = std::make_unique<task_group>( std::max<std::size_t>( limit, 0x1 ), feeder );
+        m_group_count = count + 1;
+
+        return count;
+    }
+
+    // Top of the output tree
+    pool_node * root() { return &m_root; }
+
+    // Add a node or a unit to the output of an open node
+    pool_node * node( pool_node * parent )
+    {
+        std::lock_guard<std::mutex> lock( m_output_mutex );
+
+        parent->children.emplace_back();
+        parent->children.back().node = std::make_unique<pool_node>();
+
+        return parent->children.back().node.get();
+    }
+
+    pool_unit * unit( pool_node * parent )
+    {
+        std::lock_guard<std::mutex> lock( m_output_mutex );
+
+        parent->children.emplace_back();
+        parent->children.back().unit = std::make_unique<pool_unit>();
+
+        return parent->children.back().unit.get();
+    }
+
+    // Nothing more is added to the node
+    void close( pool_node * node )
+    {
+        std::lock_guard<std::mutex> lock( m_output_mutex );
+
+        node->closed = true;
+        print_ready();
+    }
+
+    // Add a task writing to the unit (nullptr = no output), the tasks with the highest cost (e.g. size of the file)
+    // start first. All the tasks of a unit have to be added before its node is closed
+    void add( pool_unit * unit, std::uint64_t cost, std::function<void()> job, std::size_t group = 0x0 )
+    {
+        std::size_t index{ 0x0 };
+
+        if (unit != nullptr)
+        {
+            std::lock_guard<std::mutex> lock( m_output_mutex );
+
+            index = unit->output.size();
+            unit->output.emplace_back();
+            unit->remaining++;
+        }
+
+        auto & target = *m_groups[group];
+
+        m_pending++;
+
+        {
+            std::lock_guard<std::mutex> lock( target.mutex );
+
+            target.tasks.push_back( task{ unit, index, group, cost, target.added++, std::move( job ) } );
+            std::push_heap( target.tasks.begin(), target.tasks.end(), task_order );
+        }
+
+        if (!target.feeder)
+            m_queued_work++;
+
+        {
+            std::lock_guard<std::mutex> lock( m_event_mutex );
+            m_events++;
+        }
+
+        m_cv_event.notify_one();
+    }
+
+    // Run the tasks until all of them (and the ones they add) are done
+    void run()
+    {
+        std::vector<std::thread> threads{};
+
+        for (std::size_t i = 0x1; i < m_threads; i++)
+            threads.emplace_back( [this, i] () { work( i ); } );
+
+        work( 0x0 );
+
+        for (auto & thread : threads)
+            thread.join();
+
+        std::lock_guard<std::mutex> lock( m_output_mutex );
+        print_ready();
+    }
+
+private:
+    struct task
+    {
+        pool_unit * unit;
+        std::size_t index, group;
+        std::uint64_t cost, sequence;
+        std::function<void()> run;
+    };
+
+    // Heap order: the highest cost on top, tasks of the same cost in the order they were added
+    static bool task_order( const task & a, const task & b )
+    {
+        return (a.cost != b.cost) ? a.cost < b.cost : a.sequence > b.sequence;
+    }
+
+    struct task_group
+    {
+        task_group( std::size_t group_limit, bool group_feeder ) : limit( group_limit ), feeder( group_feeder ) {}
+
+        std::size_t limit;
+        bool feeder;
+        std::atomic<std::size_t> running{ 0x0 };
+
+        // Waiting tasks (a heap, task_order) and the number added so far (guarded by mutex)
+        std::vector<task> tasks{};
+        std::uint64_t added{ 0x0 };
+        std::mutex mutex{};
+    };
+
+    // Reserve a place in the group, false if it runs its limit of tasks already
+    static bool acquire( task_group & group )
+    {
+        for (auto running = group.running.load(); running < group.limit; )
+        {
+            if (group.running.compare_exchange_weak( running, running + 1 ))
+                return true;
+        }
+
+        return false;
+    }
+
+    // The most expensive task of the first group with room and tasks waiting (starting at a different group for
+    // every worker, so they spread over the devices)
+    bool next_task( std::size_t self, task & next )
+    {
+        auto const groups = m_group_count.load();
+        auto const feed = m_queued_work < m_threads * POOL_BACKLOG;
+
+        // Feeding groups first while little is waiting, last otherwise
+        for (auto const feeders : { feed, !feed })
+        {
+            for (std::size_t g = 0x0; g < groups; g++)
+            {
+                auto & group = *m_groups[(self + g) % groups];
+
+                if (group.feeder != feeders || !acquire( group ))
+                    continue;
+
+                {
+                    std::lock_guard<std::mutex> lock( group.mutex );
+
+                    if (!group.tasks.empty())
+                    {
+                        std::pop_heap( group.tasks.begin(), group.tasks.end(), task_order );
+                        next = std::move( group.tasks.back() );
+                        group.tasks.pop_back();
+
+                        if (!group.feeder)
+                            m_queued_work--;
+
+                        return true;
+                    }
+                }
+
+                group.running--;
+            }
+        }
+
+        return false;
+    }
+
+    void work( std::size_t self )
+    {
+        while (m_pending != 0x0)
+        {
+            // Events so far, a task of a full group can only start after a task is done or added
+            std::uint64_t events{ 0x0 };
+
+            {
+                std::lock_guard<std::mutex> lock( m_event_mutex );
+                events = m_events;
+            }
+
+            task next{};
+
+            if (!next_task( self, next ))
+            {
+                std::unique_lock<std::mutex> lock( m_event_mutex );
+                m_cv_event.wait( lock, [&] { return m_events != events || m_pending == 0x0; } );
+
+                continue;
+            }
+
+            std::wstring output{};
+
+            m_task_output = &output;
+            next.run();
+            m_task_output = nullptr;
+
+            m_groups[next.group]->running--;
+
+            if (next.unit != nullptr)
+            {
+                std::lock_guard<std::mutex> lock( m_output_mutex );
+
+                next.unit->output[next.index] = std::move( output );
+                next.unit->remaining--;
+
+                print_ready();
+            }
+
+            m_pending--;
+
+            {
+                std::lock_guard<std::mutex> lock( m_event_mutex );
+                m_events++;
+            }
+
+            m_cv_event.notify_all();
+        }
+    }
+
+    // Print the output tree up to the first unit not done or node not closed (m_output_mutex held)
+    void print_ready()
+    {
+        while (!m_cursor.empty())
+        {
+            auto const node = m_cursor.back().first;
+            auto const index = m_cursor.back().second;
+
+            if (!node->closed)
+                return;
+
+            // Done with the node, free what it held
+            if (index == node->children.size())
+            {
+                node->children.clear();
+                m_cursor.pop_back();
+
+                continue;
+            }
+
+            auto & child = node->children[index];
+
+            if (child.node)
+            {
+                m_cursor.back().second++;
+                m_cursor.emplace_back( child.node.get(), 0x0 );
+
+                continue;
+            }
+
+            if (child.unit->remaining != 0x0)
+                return;
+
+            for (auto & text : child.unit->output)
+                fmt::print( L"{}", text );
+
+            child.unit.reset();
+            m_cursor.back().second++;
+        }
+    }
+
+    std::size_t m_threads;
+
+    // Groups, only ever added (guarded by m_groups_mutex when adding)
+    std::array<std::unique_ptr<task_group>, POOL_GROUPS_MAX> m_groups{};
+    std::atomic<std::size_t> m_group_count{ 0x0 };
+    std::mutex m_groups_mutex{};
+
+    // Tasks added and not done yet, tasks of groups that don't feed waiting to start
+    std::atomic<std::size_t> m_pending{ 0x0 }, m_queued_work{ 0x0 };
+
+    // Tasks added or done, waited for by workers with nothing to start
+    std::uint64_t m_events{ 0x0 };
+    std::mutex m_event_mutex{};
+    std::condition_variable m_cv_event{};
+
+    // Output tree and the path to the next unit to print (guarded by m_output_mutex)
+    pool_node m_root{};
+    std::vector<std::pair<pool_node *, std::size_t>> m_cursor{ { &m_root, 0x0 } };
+    std::mutex m_output_mutex{};
+};